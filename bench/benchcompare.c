@@ -0,0 +1,272 @@
+/*
+ * Compare the latest benchmark result against a baseline (see
+ * benchresults.h) and flag statistically significant regressions
+ *
+ * Usage: benchcompare [-r runs] baseline.jsonl results.jsonl
+ *
+ * The last runs results of each file are independent runs of the same
+ * benchmark (make benchmark records BENCHMARK_RUNS of them).  Frames within
+ * one run share the run's CPU frequency, cache and scheduling luck, so the
+ * variance that matters is between runs: every run is reduced to the median
+ * time of each part of a frame (and of the whole frame), and only those
+ * per-run medians are compared.  The change is the median of the current
+ * runs over the median of the baseline runs, and its 95% confidence
+ * interval is estimated by bootstrapping - both sets of runs are resampled
+ * with replacement BOOTSTRAP_ROUNDS times and the change of each resample
+ * recorded.  A change is only reported when the whole interval is on one
+ * side of zero and the change is more than THRESHOLD.  Exits 1 if anything
+ * regressed.
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "benchresults.h"
+
+#define BOOTSTRAP_ROUNDS 2000
+#define THRESHOLD 0.05
+#define DEFAULT_RUNS 5
+#define MINIMUM_RUNS 3
+
+// fixed seed so a comparison always gives the same answer
+static uint64_t rngState = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t rng() {
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 7;
+	rngState ^= rngState << 17;
+	return rngState;
+}
+
+static int compareDouble(const void *a, const void *b) {
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static double median(double *values, size_t n) {
+	qsort(values, n, sizeof (double), compareDouble);
+	return n % 2 == 1 ? values[n / 2] :
+	    (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+static double resampledMedian(const double *values, size_t n,
+    double *scratch) {
+	for (size_t i = 0; i < n; i++) {
+		scratch[i] = values[rng() % n];
+	}
+	return median(scratch, n);
+}
+
+/*
+ * The median of a series of frame times of one run
+ */
+static double runMedian(const double *samples, size_t count,
+    double *scratch) {
+	memcpy(scratch, samples, count * sizeof (double));
+	return median(scratch, count);
+}
+
+/*
+ * Compare the per-run medians of one series, returning 1 if it regressed
+ */
+static int compareSeries(const char *name, const double *base, int baseRuns,
+    const double *cur, int curRuns) {
+	double baseScratch[baseRuns];
+	double curScratch[curRuns];
+	double *changes = malloc(BOOTSTRAP_ROUNDS * sizeof (double));
+	if (changes == NULL) {
+		err(2, "malloc");
+	}
+
+	memcpy(baseScratch, base, sizeof (baseScratch));
+	double baseMedian = median(baseScratch, baseRuns);
+	memcpy(curScratch, cur, sizeof (curScratch));
+	double curMedian = median(curScratch, curRuns);
+	if (baseMedian <= 0) {
+		printf("  %-8s no samples\n", name);
+		free(changes);
+		return 0;
+	}
+
+	for (int i = 0; i < BOOTSTRAP_ROUNDS; i++) {
+		double b = resampledMedian(base, baseRuns, baseScratch);
+		double c = resampledMedian(cur, curRuns, curScratch);
+		changes[i] = b > 0 ? c / b - 1 : 0;
+	}
+	qsort(changes, BOOTSTRAP_ROUNDS, sizeof (double), compareDouble);
+	double low = changes[(int)(BOOTSTRAP_ROUNDS * 0.025)];
+	double high = changes[(int)(BOOTSTRAP_ROUNDS * 0.975)];
+	double change = curMedian / baseMedian - 1;
+
+	const char *verdict = "same";
+	int regressed = 0;
+	if (low > 0 && change > THRESHOLD) {
+		verdict = "REGRESSED";
+		regressed = 1;
+	} else if (high < 0 && change < -THRESHOLD) {
+		verdict = "improved";
+	}
+
+	printf("  %-8s %10.3f %10.3f %+8.2f%%  [%+7.2f%%, %+7.2f%%]  %s\n",
+	    name, baseMedian, curMedian, change * 100, low * 100, high * 100,
+	    verdict);
+
+	free(changes);
+	return regressed;
+}
+
+static void printResult(const char *label, const BenchResult *r, int runs) {
+	printf("%s %s commit=%s frames=%d particles=%u runs=%d\n", label,
+	    r->time, r->commit, r->frames, r->particles, runs);
+	printf("  compiler=%s flags=%s\n", r->compiler, r->flags);
+	printf("  cpu=%s isa=%s\n", r->cpu, r->isa);
+}
+
+/*
+ * Read the last runs results of path, checking they are runs of the same
+ * benchmark.  Exits on error.
+ */
+static int readRuns(const char *path, BenchResult *results, int runs) {
+	int n = benchResultReadLast(path, results, runs);
+	if (n == -1) {
+		exit(2);
+	}
+	if (n < MINIMUM_RUNS) {
+		errx(2, "%s: %d run%s, at least %d are needed to measure the "
+		    "variance between runs", path, n, n == 1 ? "" : "s",
+		    MINIMUM_RUNS);
+	}
+	for (int i = 1; i < n; i++) {
+		if (results[i].frames != results[0].frames ||
+		    results[i].count != results[0].count) {
+			errx(2, "%s: the last %d runs simulated different "
+			    "frames, they aren't comparable", path, n);
+		}
+		if (strcmp(results[i].commit, results[0].commit) != 0) {
+			printf("warning: the last %d runs of %s are from "
+			    "different commits\n", n, path);
+			break;
+		}
+	}
+	return n;
+}
+
+/*
+ * Reduce every run to the median of each series and of the whole frame (the
+ * sum of its parts), medians[series][run]
+ */
+static void runMedians(const BenchResult *results, int runs,
+    double medians[BENCH_SERIES_COUNT + 1][runs]) {
+	size_t count = results[0].count;
+	double *frame = malloc(count * sizeof (double));
+	double *scratch = malloc(count * sizeof (double));
+	if (frame == NULL || scratch == NULL) {
+		err(2, "malloc");
+	}
+
+	for (int r = 0; r < runs; r++) {
+		memset(frame, 0, count * sizeof (double));
+		for (int i = 0; i < BENCH_SERIES_COUNT; i++) {
+			for (size_t j = 0; j < count; j++) {
+				frame[j] += results[r].samples[i][j];
+			}
+			medians[i][r] = runMedian(results[r].samples[i], count,
+			    scratch);
+		}
+		medians[BENCH_SERIES_COUNT][r] = runMedian(frame, count,
+		    scratch);
+	}
+
+	free(frame);
+	free(scratch);
+}
+
+int main(int argc, char **argv) {
+	int runs = DEFAULT_RUNS;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "r:")) != -1) {
+		switch (opt) {
+		case 'r':
+			runs = atoi(optarg);
+			break;
+		default:
+			runs = 0;
+			break;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 2 || runs < MINIMUM_RUNS) {
+		fprintf(stderr, "Usage: benchcompare [-r runs] baseline.jsonl "
+		    "results.jsonl\n");
+		fprintf(stderr, "runs (default %d) must be at least %d\n",
+		    DEFAULT_RUNS, MINIMUM_RUNS);
+		return 2;
+	}
+
+	if (access(argv[0], F_OK) != 0) {
+		printf("no baseline at %s, record one with "
+		    "'make benchmark-baseline'\n", argv[0]);
+		return 0;
+	}
+
+	BenchResult *base = calloc(runs, sizeof (BenchResult));
+	BenchResult *cur = calloc(runs, sizeof (BenchResult));
+	if (base == NULL || cur == NULL) {
+		err(2, "calloc");
+	}
+	int baseRuns = readRuns(argv[0], base, runs);
+	int curRuns = readRuns(argv[1], cur, runs);
+
+	printResult("baseline", &base[baseRuns - 1], baseRuns);
+	printResult("current ", &cur[curRuns - 1], curRuns);
+
+	if (base[0].frames != cur[0].frames || base[0].count != cur[0].count) {
+		errx(2, "the runs simulated different frames (%d vs %d), "
+		    "they aren't comparable", base[0].frames, cur[0].frames);
+	}
+	if (strcmp(base[0].cpu, cur[0].cpu) != 0) {
+		printf("warning: the runs are from different CPUs\n");
+	}
+
+	double baseMedians[BENCH_SERIES_COUNT + 1][baseRuns];
+	double curMedians[BENCH_SERIES_COUNT + 1][curRuns];
+	runMedians(base, baseRuns, baseMedians);
+	runMedians(cur, curRuns, curMedians);
+
+	printf("\n  %-8s %10s %10s %9s  %-20s\n", "median", "base us",
+	    "current us", "change", "95% interval");
+	int regressions = 0;
+	for (int i = 0; i <= BENCH_SERIES_COUNT; i++) {
+		regressions += compareSeries(i < BENCH_SERIES_COUNT ?
+		    benchSeriesNames[i] : "frame", baseMedians[i], baseRuns,
+		    curMedians[i], curRuns);
+	}
+
+	for (int i = 0; i < baseRuns; i++) {
+		benchResultFree(&base[i]);
+	}
+	for (int i = 0; i < curRuns; i++) {
+		benchResultFree(&cur[i]);
+	}
+	free(base);
+	free(cur);
+
+	if (regressions > 0) {
+		printf("\n%d regression%s\n", regressions,
+		    regressions == 1 ? "" : "s");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,90 @@
+/*
+ * Benchmark the FFT and the full per-hop audio analysis at several sizes
+ *
+ * Usage: fftbench
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "analysis.h"
+#include "fft.h"
+
+#define SAMPLE_RATE 44100
+#define MINIMUM_TIME 0.5
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+	unsigned int sizes[] = { 1024, 2048, 4096 };
+
+	printf("%6s %6s %12s %12s %10s\n", "n", "hop", "fft ns", "hop ns",
+	    "% realtime");
+
+	for (int s = 0; s < sizeof (sizes) / sizeof (sizes[0]); s++) {
+		unsigned int n = sizes[s];
+		unsigned int hopSize = n / 2;
+		AudioFeatures features;
+
+		FFT *fft = fftCreate(n);
+		Analyzer *analyzer = analyzerCreate(n, SAMPLE_RATE);
+		float *in = malloc(sizeof (float) * n);
+		float *power = malloc(sizeof (float) * (n / 2 + 1));
+		if (fft == NULL || analyzer == NULL || in == NULL ||
+		    power == NULL) {
+			errx(1, "failed to create n=%u", n);
+		}
+
+		for (unsigned int i = 0; i < n; i++) {
+			in[i] = (float)rand() / RAND_MAX * 2 - 1;
+		}
+
+		// warm up
+		for (int i = 0; i < 100; i++) {
+			fftPowerSpectrum(fft, in, power);
+			analyzerProcess(analyzer, in, hopSize, &features);
+		}
+
+		unsigned long iterations = 0;
+		double start = now();
+		double elapsed;
+		do {
+			fftPowerSpectrum(fft, in, power);
+			iterations++;
+			elapsed = now() - start;
+		} while (elapsed < MINIMUM_TIME);
+		double fftNs = elapsed / iterations * 1e9;
+
+		iterations = 0;
+		start = now();
+		do {
+			analyzerProcess(analyzer, in, hopSize, &features);
+			iterations++;
+			elapsed = now() - start;
+		} while (elapsed < MINIMUM_TIME);
+		double hopNs = elapsed / iterations * 1e9;
+
+		// how much of the time a hop represents is spent analyzing it
+		double hopDurationNs = (double)hopSize / SAMPLE_RATE * 1e9;
+
+		printf("%6u %6u %12.1f %12.1f %10.4f\n", n, hopSize, fftNs,
+		    hopNs, hopNs / hopDurationNs * 100);
+
+		fftDestroy(fft);
+		analyzerDestroy(analyzer);
+		free(in);
+		free(power);
+	}
+
+	return 0;
+}
@@ -0,0 +1,311 @@
+/*
+ * Microbenchmarks of the per-particle and per-color kernels
+ *
+ * Usage: microbench [filter]
+ *
+ * Every kernel is run over a batch of inputs at several batch sizes.  Each
+ * measurement warms up first (which also picks how many passes over the
+ * batch make a repetition of at least MINIMUM_REP_NS) and then takes REPS
+ * repetitions, timed with the CPU's cycle counter where there is one (the
+ * TSC on x86, the virtual counter on arm64, nanoseconds otherwise).  The
+ * median and minimum cost per item are printed - the minimum is the most
+ * repeatable number for comparing two builds on the same machine.
+ *
+ * Only kernels whose name contains filter run, if it's given.
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "palette.h"
+#include "particle.h"
+#include "ryb2rgb.h"
+
+#define WARMUP_NS 20000000
+#define MINIMUM_REP_NS 2000000
+#define REPS 15
+#define MAX_BATCH 65536
+// samples along each axis of the color cube, as in --colorCubeSize 33
+#define CUBE_SIZE 33
+
+static const unsigned int batches[] = { 16, 256, 4096, 65536 };
+#define NUM_BATCHES (sizeof (batches) / sizeof (batches[0]))
+
+// results are folded in here so the compiler can't drop the work
+static volatile float sink;
+
+static uint64_t nowNs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static const char *counterName =
+#if defined(__x86_64__) || defined(__i386__)
+    "cycles";
+#elif defined(__aarch64__)
+    "ticks";
+#else
+    "ns";
+#endif
+
+static inline uint64_t counterNow() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#elif defined(__aarch64__)
+	uint64_t t;
+	__asm__ volatile("isb; mrs %0, cntvct_el0" : "=r" (t));
+	return t;
+#else
+	return nowNs();
+#endif
+}
+
+/*
+ * The inputs every kernel works on, filled once with fixed random values
+ */
+static Particle particles[MAX_BATCH];
+static float inputs[MAX_BATCH][3];
+static unsigned int indexes[MAX_BATCH];
+static float magic[8][3];
+static RYBPalette rybPalette;
+static RYBCube *cube;
+static Palette paletteA;
+static Palette paletteB;
+static Palette paletteOut;
+
+// particleInit's output, kept apart so it doesn't overwrite particles[]
+static Particle initialized[MAX_BATCH];
+
+typedef void (*Kernel)(unsigned int n);
+
+static void benchParticleInit(unsigned int n) {
+	for (unsigned int i = 0; i < n; i++) {
+		particleInit(&initialized[i], i % 1000, 1 + i % 5, i % 5,
+		    i % 30, i % 200, indexes[i] % 360, indexes[i]);
+	}
+	sink = initialized[n - 1].position;
+}
+
+static void benchParticleCalculateCoordinates(unsigned int n) {
+	for (unsigned int i = 0; i < n; i++) {
+		particles[i].position += 0.5f;
+		particleCalculateCoordinates(&particles[i]);
+	}
+	sink = particles[n - 1].x;
+}
+
+static void benchInterpolate2rgb(unsigned int n) {
+	float acc = 0;
+	for (unsigned int i = 0; i < n; i++) {
+		RGB rgb = interpolate2rgb(inputs[i][0], inputs[i][1],
+		    inputs[i][2], magic);
+		acc += rgb.r + rgb.g + rgb.b;
+	}
+	sink = acc;
+}
+
+static void benchRybPaletteEval(unsigned int n) {
+	float acc = 0;
+	for (unsigned int i = 0; i < n; i++) {
+		RGB rgb = rybPaletteEval(&rybPalette, inputs[i][0],
+		    inputs[i][1], inputs[i][2]);
+		acc += rgb.r + rgb.g + rgb.b;
+	}
+	sink = acc;
+}
+
+static void benchRybCubeLookup(unsigned int n) {
+	float acc = 0;
+	for (unsigned int i = 0; i < n; i++) {
+		RGB rgb = rybCubeLookup(cube, inputs[i][0], inputs[i][1],
+		    inputs[i][2]);
+		acc += rgb.r + rgb.g + rgb.b;
+	}
+	sink = acc;
+}
+
+// rebuilding the cube after the colors are randomized, the batch is every
+// grid point
+static void benchRybCubeBuild(unsigned int n) {
+	rybCubeBuild(cube, magic);
+	sink = cube->data[n - 1].r;
+}
+
+static void benchRyb2rgb(unsigned int n) {
+	float acc = 0;
+	for (unsigned int i = 0; i < n; i++) {
+		RGB rgb = ryb2rgb(inputs[i][0], inputs[i][1], inputs[i][2]);
+		acc += rgb.r + rgb.g + rgb.b;
+	}
+	sink = acc;
+}
+
+static void benchRainbow(unsigned int n) {
+	float acc = 0;
+	for (unsigned int i = 0; i < n; i++) {
+		RGB rgb = rainbow(indexes[i]);
+		acc += rgb.r + rgb.g + rgb.b;
+	}
+	sink = acc;
+}
+
+/*
+ * What coloring a particle costs now: a palette lookup by rainbow index
+ */
+static void benchPaletteLookup(unsigned int n) {
+	float acc = 0;
+	for (unsigned int i = 0; i < n; i++) {
+		RGB rgb = paletteA.colors[indexes[i]];
+		acc += rgb.r + rgb.g + rgb.b;
+	}
+	sink = acc;
+}
+
+// whole-table kernels, the batch is always MAX_COLORS
+static void benchPaletteFill(unsigned int n) {
+	paletteFill(&paletteOut, &rybPalette);
+	sink = paletteOut.colors[n - 1].r;
+}
+
+static void benchPaletteFillFromCube(unsigned int n) {
+	paletteFillFromCube(&paletteOut, cube);
+	sink = paletteOut.colors[n - 1].r;
+}
+
+static void benchPaletteBlend(unsigned int n) {
+	paletteBlend(&paletteOut, &paletteA, &paletteB, 0.37f);
+	sink = paletteOut.colors[n - 1].r;
+}
+
+struct Benchmark {
+	const char *name;
+	Kernel kernel;
+	// fixed batch size, 0 to run at every size in batches
+	unsigned int batch;
+};
+
+static const struct Benchmark benchmarks[] = {
+	{ "particleInit", benchParticleInit, 0 },
+	{ "particleCalculateCoordinates", benchParticleCalculateCoordinates,
+	    0 },
+	{ "interpolate2rgb", benchInterpolate2rgb, 0 },
+	{ "rybPaletteEval", benchRybPaletteEval, 0 },
+	{ "rybCubeLookup", benchRybCubeLookup, 0 },
+	{ "rybCubeBuild", benchRybCubeBuild,
+	    CUBE_SIZE * CUBE_SIZE * CUBE_SIZE },
+	{ "ryb2rgb", benchRyb2rgb, 0 },
+	{ "rainbow", benchRainbow, 0 },
+	{ "paletteLookup", benchPaletteLookup, 0 },
+	{ "paletteFill", benchPaletteFill, MAX_COLORS },
+	{ "paletteFillFromCube", benchPaletteFillFromCube, MAX_COLORS },
+	{ "paletteBlend", benchPaletteBlend, MAX_COLORS }
+};
+#define NUM_BENCHMARKS (sizeof (benchmarks) / sizeof (benchmarks[0]))
+
+static int compareU64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+static void run(const struct Benchmark *b, unsigned int n) {
+	uint64_t counts[REPS];
+	uint64_t times[REPS];
+
+	// warm up, counting how many passes fit in the warm up time
+	unsigned long passes = 0;
+	uint64_t start = nowNs();
+	uint64_t elapsed;
+	do {
+		b->kernel(n);
+		passes++;
+		elapsed = nowNs() - start;
+	} while (elapsed < WARMUP_NS);
+
+	unsigned long perRep = (double)passes * MINIMUM_REP_NS / elapsed;
+	if (perRep < 1) {
+		perRep = 1;
+	}
+
+	for (int r = 0; r < REPS; r++) {
+		uint64_t t0 = nowNs();
+		uint64_t c0 = counterNow();
+		for (unsigned long i = 0; i < perRep; i++) {
+			b->kernel(n);
+		}
+		counts[r] = counterNow() - c0;
+		times[r] = nowNs() - t0;
+	}
+
+	qsort(counts, REPS, sizeof (uint64_t), compareU64);
+	qsort(times, REPS, sizeof (uint64_t), compareU64);
+
+	double items = (double)perRep * n;
+	printf("%-30s %6u %10.2f %12.2f %12.2f\n", b->name, n,
+	    times[REPS / 2] / items, counts[REPS / 2] / items,
+	    counts[0] / items);
+}
+
+int main(int argc, char **argv) {
+	const char *filter = argc > 1 ? argv[1] : NULL;
+
+	srand(1);
+	for (int i = 0; i < 8; i++) {
+		for (int j = 0; j < 3; j++) {
+			magic[i][j] = (float)rand() / RAND_MAX;
+		}
+	}
+	for (unsigned int i = 0; i < MAX_BATCH; i++) {
+		for (int j = 0; j < 3; j++) {
+			inputs[i][j] = (float)rand() / RAND_MAX;
+		}
+		indexes[i] = rand() % MAX_COLORS;
+		particleInit(&particles[i], 0, 1, 1 + rand() % 200, 0, 0,
+		    rand() % 360, 0);
+	}
+
+	rybPaletteCompile(&rybPalette, magic);
+	cube = rybCubeCreate(CUBE_SIZE);
+	if (cube == NULL) {
+		errx(1, "failed to create color cube");
+	}
+	rybCubeBuild(cube, magic);
+	paletteFill(&paletteA, &rybPalette);
+	for (int i = 0; i < 8; i++) {
+		magic[i][0] = 1 - magic[i][0];
+	}
+	rybPaletteCompile(&rybPalette, magic);
+	paletteFill(&paletteB, &rybPalette);
+
+	printf("%-30s %6s %10s %12s %12s\n", "kernel", "batch", "ns/item",
+	    counterName, "min");
+	for (unsigned int i = 0; i < NUM_BENCHMARKS; i++) {
+		const struct Benchmark *b = &benchmarks[i];
+		if (filter != NULL && strstr(b->name, filter) == NULL) {
+			continue;
+		}
+		if (b->batch > 0) {
+			run(b, b->batch);
+			continue;
+		}
+		for (unsigned int j = 0; j < NUM_BATCHES; j++) {
+			run(b, batches[j]);
+		}
+	}
+
+	rybCubeDestroy(cube);
+	return 0;
+}
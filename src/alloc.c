@@ -0,0 +1,115 @@
+/*
+ * Allocation accounting
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#include <assert.h>
+#include <err.h>
+#include <stdlib.h>
+
+#include "alloc.h"
+
+const char *allocSubsystemNames[ALLOC_SUBSYSTEM_COUNT] = {
+	"particles",
+	"particleNodes",
+	"rings",
+	"colors"
+};
+
+static AllocStats stats[ALLOC_SUBSYSTEM_COUNT];
+static bool steadyState = false;
+static unsigned long frame = 0;
+
+/*
+ * Any allocation in the steady state is a bug - fail loudly (abort() so a
+ * debugger or core file shows where it came from)
+ */
+static void allocCheckSteadyState(enum AllocSubsystem sub, size_t size) {
+	if (!steadyState) {
+		return;
+	}
+
+	warnx("allocation in steady state: %zu bytes for %s in frame %lu "
+	    "(%lu allocations, %ld live)", size, allocSubsystemNames[sub],
+	    frame, stats[sub].allocations, stats[sub].live);
+	abort();
+}
+
+static void allocCount(enum AllocSubsystem sub, size_t size) {
+	AllocStats *s = &stats[sub];
+
+	s->frameAllocations++;
+	s->frameBytes += size;
+	s->allocations++;
+	s->bytes += size;
+}
+
+/*
+ * Record a new object of size bytes
+ */
+void allocRecord(enum AllocSubsystem sub, size_t size) {
+	assert(sub < ALLOC_SUBSYSTEM_COUNT);
+	allocCheckSteadyState(sub, size);
+
+	allocCount(sub, size);
+	stats[sub].live++;
+	stats[sub].liveBytes += size;
+}
+
+/*
+ * Record an existing object (oldSize 0 if it is new) growing or shrinking to
+ * newSize bytes
+ */
+void allocRecordResize(enum AllocSubsystem sub, size_t oldSize,
+    size_t newSize) {
+
+	assert(sub < ALLOC_SUBSYSTEM_COUNT);
+	allocCheckSteadyState(sub, newSize);
+
+	allocCount(sub, newSize);
+	if (oldSize == 0) {
+		stats[sub].live++;
+	}
+	stats[sub].liveBytes += (long long)newSize - (long long)oldSize;
+}
+
+/*
+ * Record an object of size bytes being freed (or dropped from a pool for
+ * good, a recycled object is still live)
+ */
+void allocRecordFree(enum AllocSubsystem sub, size_t size) {
+	assert(sub < ALLOC_SUBSYSTEM_COUNT);
+
+	stats[sub].live--;
+	stats[sub].liveBytes -= size;
+}
+
+/*
+ * Start counting a new frame
+ */
+void allocFrameBegin() {
+	for (int i = 0; i < ALLOC_SUBSYSTEM_COUNT; i++) {
+		stats[i].frameAllocations = 0;
+		stats[i].frameBytes = 0;
+	}
+	frame++;
+}
+
+const AllocStats *allocStats(enum AllocSubsystem sub) {
+	assert(sub < ALLOC_SUBSYSTEM_COUNT);
+	return &stats[sub];
+}
+
+/*
+ * Once in the steady state, any allocation aborts
+ */
+void allocSetSteadyState(bool steady) {
+	steadyState = steady;
+}
+
+bool allocSteadyState() {
+	return steadyState;
+}
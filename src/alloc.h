@@ -0,0 +1,59 @@
+/*
+ * Allocation accounting
+ *
+ * Allocations made by the simulation are recorded here by subsystem: how
+ * many were made and how many bytes this frame and in total, and how many
+ * objects are live.  Once allocSetSteadyState() is called any further
+ * allocation is treated as a bug and aborts with a description of it.
+ *
+ * This only counts, the callers still do the allocating (see safeMalloc()
+ * in undercurrents.c).
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+enum AllocSubsystem {
+	AllocParticles,
+	AllocParticleNodes,
+	AllocRings,
+	AllocColors,
+	ALLOC_SUBSYSTEM_COUNT
+};
+
+typedef struct AllocStats {
+	// this frame
+	unsigned long frameAllocations;
+	unsigned long frameBytes;
+
+	// since startup
+	unsigned long allocations;
+	unsigned long long bytes;
+
+	// objects allocated and not yet freed, and their size.  Particles,
+	// their nodes and rings are recycled, never freed, so for those this
+	// is every object ever allocated; only the color cube is freed (when
+	// colorCubeSize changes)
+	long live;
+	long long liveBytes;
+} AllocStats;
+
+extern const char *allocSubsystemNames[ALLOC_SUBSYSTEM_COUNT];
+
+void allocRecord(enum AllocSubsystem sub, size_t size);
+void allocRecordResize(enum AllocSubsystem sub, size_t oldSize,
+    size_t newSize);
+void allocRecordFree(enum AllocSubsystem sub, size_t size);
+void allocFrameBegin();
+const AllocStats *allocStats(enum AllocSubsystem sub);
+void allocSetSteadyState(bool steady);
+bool allocSteadyState();
+
+#endif
@@ -0,0 +1,156 @@
+/*
+ * Spectral features of an audio stream
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analysis.h"
+
+/*
+ * Create an analyzer using an n point FFT for audio at the given sample rate.
+ *
+ * Returns NULL on failure.  Must be freed by the caller with
+ * analyzerDestroy()
+ */
+Analyzer *analyzerCreate(unsigned int n, int rate) {
+	if (rate <= 0) {
+		return NULL;
+	}
+
+	Analyzer *analyzer = calloc(1, sizeof (Analyzer));
+	if (analyzer == NULL) {
+		return NULL;
+	}
+
+	analyzer->fft = fftCreate(n);
+	analyzer->samples = calloc(n, sizeof (float));
+	analyzer->power = calloc(n / 2 + 1, sizeof (float));
+	analyzer->previous = calloc(n / 2 + 1, sizeof (float));
+	if (analyzer->fft == NULL || analyzer->samples == NULL ||
+	    analyzer->power == NULL || analyzer->previous == NULL) {
+		analyzerDestroy(analyzer);
+		return NULL;
+	}
+
+	analyzer->n = n;
+	analyzer->rate = rate;
+	analyzer->lastOnset = -INFINITY;
+
+	// log spaced band edges, clamped to the available bins
+	double maxFrequency = fmin(ANALYSIS_FREQUENCY_MAXIMUM, rate / 2.0);
+	double ratio = maxFrequency / ANALYSIS_FREQUENCY_MINIMUM;
+	for (int b = 0; b <= ANALYSIS_BANDS; b++) {
+		double f = ANALYSIS_FREQUENCY_MINIMUM *
+		    pow(ratio, (double)b / ANALYSIS_BANDS);
+		unsigned int bin = f * n / rate;
+		if (bin < 1) {
+			bin = 1;
+		}
+		if (bin > n / 2) {
+			bin = n / 2;
+		}
+		analyzer->bandBins[b] = bin;
+	}
+
+	return analyzer;
+}
+
+/*
+ * Feed the next hopSize samples (1 to n) through the analyzer and fill in the
+ * features for them.
+ */
+void analyzerProcess(Analyzer *analyzer, const float *hop,
+    unsigned int hopSize, AudioFeatures *features) {
+
+	unsigned int n = analyzer->n;
+	unsigned int bins = n / 2 + 1;
+
+	assert(hopSize > 0 && hopSize <= n);
+
+	// slide the window along by a hop
+	memmove(analyzer->samples, analyzer->samples + hopSize,
+	    sizeof (float) * (n - hopSize));
+	memcpy(analyzer->samples + n - hopSize, hop, sizeof (float) * hopSize);
+
+	analyzer->hops++;
+	analyzer->samplesSeen += hopSize;
+	features->hop = analyzer->hops;
+	features->time = (double)analyzer->samplesSeen / analyzer->rate;
+
+	// level of just this hop
+	float sum = 0;
+	for (unsigned int i = 0; i < hopSize; i++) {
+		sum += hop[i] * hop[i];
+	}
+	features->level = sqrtf(sum / hopSize);
+
+	fftPowerSpectrum(analyzer->fft, analyzer->samples, analyzer->power);
+
+	// band energies
+	for (int b = 0; b < ANALYSIS_BANDS; b++) {
+		unsigned int lo = analyzer->bandBins[b];
+		unsigned int hi = analyzer->bandBins[b + 1];
+		float energy = 0;
+
+		// always use at least 1 bin
+		if (hi <= lo) {
+			hi = lo + 1;
+		}
+		for (unsigned int k = lo; k < hi && k < bins; k++) {
+			energy += analyzer->power[k];
+		}
+
+		float db = 10.0f * log10f(energy + 1e-12f);
+		float v = (db + ANALYSIS_DB_RANGE) / ANALYSIS_DB_RANGE;
+		features->bands[b] = fminf(fmaxf(v, 0), 1);
+	}
+
+	// spectral flux: how much the magnitudes increased since last hop
+	float flux = 0;
+	for (unsigned int k = 0; k < bins; k++) {
+		float mag = sqrtf(analyzer->power[k]);
+		float diff = mag - analyzer->previous[k];
+		if (diff > 0) {
+			flux += diff;
+		}
+		analyzer->previous[k] = mag;
+	}
+	features->flux = flux;
+
+	// adaptive threshold over the recent flux values
+	float mean = 0;
+	for (int i = 0; i < ANALYSIS_ONSET_HISTORY; i++) {
+		mean += analyzer->fluxHistory[i];
+	}
+	mean /= ANALYSIS_ONSET_HISTORY;
+	analyzer->fluxHistory[analyzer->hops % ANALYSIS_ONSET_HISTORY] = flux;
+
+	features->onset = false;
+	if (flux > mean * ANALYSIS_ONSET_SENSITIVITY && flux > 1e-3f &&
+	    features->time - analyzer->lastOnset >=
+	    ANALYSIS_ONSET_MINIMUM_INTERVAL) {
+		features->onset = true;
+		analyzer->lastOnset = features->time;
+	}
+}
+
+/*
+ * Free an analyzer
+ */
+void analyzerDestroy(Analyzer *analyzer) {
+	if (analyzer == NULL) {
+		return;
+	}
+	fftDestroy(analyzer->fft);
+	free(analyzer->samples);
+	free(analyzer->power);
+	free(analyzer->previous);
+	free(analyzer);
+}
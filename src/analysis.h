@@ -0,0 +1,86 @@
+/*
+ * Spectral features of an audio stream
+ *
+ * Mono samples are fed in one hop at a time (hops can vary in length, up to
+ * n samples).  For every hop, the last n samples are run through an FFT and
+ * reduced to a small AudioFeatures struct: the RMS level, energy in a handful
+ * of log spaced frequency bands and a spectral flux based onset detector.
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <stdbool.h>
+
+#include "fft.h"
+
+// Number of log spaced frequency bands
+#define ANALYSIS_BANDS 8
+
+// Band edges (in Hz)
+#define ANALYSIS_FREQUENCY_MINIMUM 40.0
+#define ANALYSIS_FREQUENCY_MAXIMUM 16000.0
+
+// Band energies are mapped from this many dB below full scale (0) up to 1
+#define ANALYSIS_DB_RANGE 80.0
+
+// Number of previous flux values used for the adaptive onset threshold
+#define ANALYSIS_ONSET_HISTORY 16
+
+// How far over the average flux a hop needs to be to count as an onset
+#define ANALYSIS_ONSET_SENSITIVITY 1.5
+
+// Minimum time (in seconds) between onsets
+#define ANALYSIS_ONSET_MINIMUM_INTERVAL 0.1
+
+typedef struct AudioFeatures {
+	// hop number (starting at 1, 0 means no features yet)
+	unsigned long hop;
+
+	// time (in seconds) of the end of the hop
+	double time;
+
+	// RMS level of the hop
+	float level;
+
+	// band energies, 0 (silent) to 1 (full scale)
+	float bands[ANALYSIS_BANDS];
+
+	// spectral flux and if it was detected as an onset
+	float flux;
+	bool onset;
+} AudioFeatures;
+
+typedef struct Analyzer {
+	FFT *fft;
+	unsigned int n;
+	int rate;
+
+	// the last n samples
+	float *samples;
+
+	// power spectrum (n / 2 + 1 bins) and the previous hop's magnitudes
+	float *power;
+	float *previous;
+
+	// first bin of each band (ANALYSIS_BANDS + 1 entries)
+	unsigned int bandBins[ANALYSIS_BANDS + 1];
+
+	// onset detection state
+	float fluxHistory[ANALYSIS_ONSET_HISTORY];
+	double lastOnset;
+
+	unsigned long hops;
+	unsigned long samplesSeen;
+} Analyzer;
+
+Analyzer *analyzerCreate(unsigned int n, int rate);
+void analyzerProcess(Analyzer *analyzer, const float *hop,
+    unsigned int hopSize, AudioFeatures *features);
+void analyzerDestroy(Analyzer *analyzer);
+
+#endif
@@ -0,0 +1,464 @@
+/*
+ * Audio file playback and analysis
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#include <assert.h>
+#include <err.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "audio.h"
+#include "realtime.h"
+#include "trace.h"
+
+// WAV format tags
+#define WAVE_FORMAT_PCM 1
+#define WAVE_FORMAT_IEEE_FLOAT 3
+#define WAVE_FORMAT_EXTENSIBLE 0xfffe
+
+// Seconds of mono samples the analysis ring can hold
+#define AUDIO_RING_SECONDS 1
+
+static uint16_t le16(const unsigned char *p) {
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t le32(const unsigned char *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/*
+ * Parse the RIFF/WAVE header of the mmap'd file.  Only 16-bit integer and
+ * 32-bit float PCM with 1 or 2 channels are supported.
+ */
+static bool audioParseWav(Audio *audio, const char *path) {
+	const unsigned char *p = audio->map;
+	const unsigned char *end = p + audio->mapSize;
+	bool haveFormat = false;
+
+	if (audio->mapSize < 12 || memcmp(p, "RIFF", 4) != 0 ||
+	    memcmp(p + 8, "WAVE", 4) != 0) {
+		warnx("%s: not a RIFF/WAVE file", path);
+		return false;
+	}
+	p += 12;
+
+	// walk the chunks looking for "fmt " and "data"
+	while (end - p >= 8) {
+		const unsigned char *chunk = p + 8;
+		uint32_t size = le32(p + 4);
+
+		if (size > (size_t)(end - chunk)) {
+			// tolerate a truncated final data chunk
+			size = end - chunk;
+		}
+
+		if (memcmp(p, "fmt ", 4) == 0 && size >= 16) {
+			int format = le16(chunk);
+			if (format == WAVE_FORMAT_EXTENSIBLE && size >= 26) {
+				format = le16(chunk + 24);
+			}
+			audio->channels = le16(chunk + 2);
+			audio->rate = le32(chunk + 4);
+			audio->bytesPerSample = le16(chunk + 14) / 8;
+
+			if (format == WAVE_FORMAT_PCM &&
+			    audio->bytesPerSample == 2) {
+				audio->isFloat = false;
+			} else if (format == WAVE_FORMAT_IEEE_FLOAT &&
+			    audio->bytesPerSample == 4) {
+				audio->isFloat = true;
+			} else {
+				warnx("%s: unsupported sample format %d "
+				    "(%d bits)", path, format,
+				    audio->bytesPerSample * 8);
+				return false;
+			}
+
+			if (audio->channels < 1 || audio->channels > 2 ||
+			    audio->rate <= 0) {
+				warnx("%s: unsupported channels=%d rate=%d",
+				    path, audio->channels, audio->rate);
+				return false;
+			}
+			haveFormat = true;
+		} else if (memcmp(p, "data", 4) == 0) {
+			if (!haveFormat) {
+				warnx("%s: data chunk before fmt chunk", path);
+				return false;
+			}
+			audio->data = chunk;
+			audio->frames = size /
+			    (audio->bytesPerSample * audio->channels);
+			return true;
+		}
+
+		// chunks are padded to an even size
+		p = chunk + size + (size & 1);
+	}
+
+	warnx("%s: no data chunk found", path);
+	return false;
+}
+
+/*
+ * mmap and parse a WAV file.
+ *
+ * Returns NULL (after printing why) on failure.  Must be freed by the caller
+ * with audioClose()
+ */
+Audio *audioOpen(const char *path) {
+	Audio *audio = calloc(1, sizeof (Audio));
+	if (audio == NULL) {
+		warn("audioOpen calloc");
+		return NULL;
+	}
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		warn("open %s", path);
+		free(audio);
+		return NULL;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		warn("fstat %s", path);
+		close(fd);
+		free(audio);
+		return NULL;
+	}
+
+	audio->mapSize = st.st_size;
+	audio->map = mmap(NULL, audio->mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (audio->map == MAP_FAILED) {
+		warn("mmap %s", path);
+		free(audio);
+		return NULL;
+	}
+
+	// we read the file front to back from the audio callback, so ask for
+	// it to be paged in ahead of time
+	madvise(audio->map, audio->mapSize, MADV_SEQUENTIAL);
+	madvise(audio->map, audio->mapSize, MADV_WILLNEED);
+
+	if (!audioParseWav(audio, path)) {
+		munmap(audio->map, audio->mapSize);
+		free(audio);
+		return NULL;
+	}
+
+	return audio;
+}
+
+/*
+ * Read a single sample (as a float from -1 to 1) from the file
+ */
+static float audioSample(Audio *audio, size_t frame, int channel) {
+	const unsigned char *p = audio->data +
+	    (frame * audio->channels + channel) * audio->bytesPerSample;
+
+	if (audio->isFloat) {
+		float f;
+		memcpy(&f, p, sizeof (f));
+		return f;
+	}
+
+	return (int16_t)le16(p) / 32768.0f;
+}
+
+/*
+ * Read count frames starting at frame "start", mixed down to mono, without
+ * playing them.  Frames past the end of the file are read as silence.
+ * Returns the number of frames that came from the file.
+ */
+size_t audioReadMono(Audio *audio, size_t start, size_t count, float *out) {
+	size_t n = start < audio->frames ? audio->frames - start : 0;
+	if (n > count) {
+		n = count;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		float sum = 0;
+		for (int c = 0; c < audio->channels; c++) {
+			sum += audioSample(audio, start + i, c);
+		}
+		out[i] = sum / audio->channels;
+	}
+	memset(out + n, 0, (count - n) * sizeof (float));
+
+	return n;
+}
+
+/*
+ * SDL audio callback - runs on the SDL audio thread.  This must never block:
+ * it only reads the mmap'd file and pushes into the lock-free ring.
+ */
+static void audioCallback(void *userdata, Uint8 *stream, int len) {
+	Audio *audio = userdata;
+	float *out = (float *)stream;
+	int channels = audio->channels;
+	size_t wanted = len / (sizeof (float) * channels);
+	size_t pos = atomic_load_explicit(&audio->position,
+	    memory_order_relaxed);
+	size_t n = audio->frames - pos;
+
+	assert(wanted <= audio->spec.samples);
+	if (n > wanted) {
+		n = wanted;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		float sum = 0;
+		for (int c = 0; c < channels; c++) {
+			float sample = audioSample(audio, pos + i, c);
+			*out++ = sample;
+			sum += sample;
+		}
+		audio->mixdown[i] = sum / channels;
+	}
+
+	// silence once the track has ended
+	memset(out, 0, (wanted - n) * channels * sizeof (float));
+
+	// advance the clock (seqlock write, see audioClock())
+	unsigned int seq = atomic_load_explicit(&audio->clockSeq,
+	    memory_order_relaxed);
+	atomic_store_explicit(&audio->clockSeq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	audio->positionCounter = SDL_GetPerformanceCounter();
+	atomic_store_explicit(&audio->position, pos + n, memory_order_relaxed);
+	atomic_store_explicit(&audio->clockSeq, seq + 2, memory_order_release);
+
+	size_t pushed = spscPush(audio->ring, audio->mixdown, n);
+	if (pushed < n) {
+		atomic_fetch_add_explicit(&audio->overflows, n - pushed,
+		    memory_order_relaxed);
+	}
+}
+
+/*
+ * Analysis thread - drains the ring one hop at a time and publishes the
+ * results for the render thread.
+ */
+static void *audioAnalysisThread(void *arg) {
+	Audio *audio = arg;
+	float hop[AUDIO_HOP_SIZE];
+	size_t have = 0;
+	bool waited = false;
+
+	// sleep roughly one hop worth of audio when there isn't enough data
+	long hopNs = (long)AUDIO_HOP_SIZE * 1000000000L / audio->rate;
+	struct timespec hopSleep = { hopNs / 1000000000L, hopNs % 1000000000L };
+
+	traceThreadName("audio-analysis");
+	realtimeWorkerThread();
+
+	while (atomic_load(&audio->running)) {
+		size_t n = spscPop(audio->ring, hop + have,
+		    AUDIO_HOP_SIZE - have);
+		have += n;
+
+		if (have < AUDIO_HOP_SIZE) {
+			// still nothing after waiting a full hop
+			if (n == 0 && waited && !audioFinished(audio)) {
+				atomic_fetch_add_explicit(&audio->underflows,
+				    1, memory_order_relaxed);
+			}
+			waited = true;
+			nanosleep(&hopSleep, NULL);
+			continue;
+		}
+		have = 0;
+		waited = false;
+
+		AudioFeatures features;
+		TRACE_BEGIN("analyze");
+		analyzerProcess(audio->analyzer, hop, AUDIO_HOP_SIZE,
+		    &features);
+		TRACE_END("analyze");
+
+		// publish (seqlock write: odd while being written)
+		unsigned int seq = atomic_load_explicit(&audio->featuresSeq,
+		    memory_order_relaxed);
+		atomic_store_explicit(&audio->featuresSeq, seq + 1,
+		    memory_order_relaxed);
+		atomic_thread_fence(memory_order_release);
+		audio->features = features;
+		atomic_store_explicit(&audio->featuresSeq, seq + 2,
+		    memory_order_release);
+	}
+
+	return NULL;
+}
+
+/*
+ * Open the audio device, start the analysis thread and start playback.
+ *
+ * Returns false (after printing why) on failure.
+ */
+bool audioStart(Audio *audio) {
+	if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0) {
+		warnx("SDL_InitSubSystem audio: %s", SDL_GetError());
+		return false;
+	}
+
+	SDL_AudioSpec want;
+	memset(&want, 0, sizeof (want));
+	want.freq = audio->rate;
+	want.format = AUDIO_F32SYS;
+	want.channels = audio->channels;
+	want.samples = AUDIO_HOP_SIZE;
+	want.callback = audioCallback;
+	want.userdata = audio;
+
+	// no allowed changes - SDL converts to the device format for us
+	audio->device = SDL_OpenAudioDevice(NULL, 0, &want, &audio->spec, 0);
+	if (audio->device == 0) {
+		warnx("SDL_OpenAudioDevice: %s", SDL_GetError());
+		return false;
+	}
+
+	audio->mixdown = malloc(sizeof (float) * audio->spec.samples);
+	audio->ring = spscCreate(sizeof (float),
+	    audio->rate * AUDIO_RING_SECONDS);
+	audio->analyzer = analyzerCreate(AUDIO_FFT_SIZE, audio->rate);
+	if (audio->mixdown == NULL || audio->ring == NULL ||
+	    audio->analyzer == NULL) {
+		warn("audioStart malloc");
+		return false;
+	}
+
+	atomic_store(&audio->running, true);
+	int ret = pthread_create(&audio->thread, NULL, audioAnalysisThread,
+	    audio);
+	if (ret != 0) {
+		warnx("pthread_create: %s", strerror(ret));
+		return false;
+	}
+	audio->threadStarted = true;
+
+	SDL_PauseAudioDevice(audio->device, 0);
+
+	return true;
+}
+
+/*
+ * Seconds of audio handed to the device so far
+ */
+double audioTime(Audio *audio) {
+	size_t pos = atomic_load_explicit(&audio->position,
+	    memory_order_acquire);
+	return (double)pos / audio->rate;
+}
+
+/*
+ * Seconds of audio that have actually come out of the speakers so far.
+ *
+ * Everything handed to the device is assumed to take one device buffer to
+ * play, so the clock runs one buffer behind audioTime() and is interpolated
+ * with the wall clock between callbacks to keep it smooth.
+ */
+double audioClock(Audio *audio) {
+	size_t pos;
+	Uint64 counter;
+
+	for (;;) {
+		unsigned int seq1 = atomic_load_explicit(&audio->clockSeq,
+		    memory_order_acquire);
+		if (seq1 & 1) {
+			continue;
+		}
+
+		pos = atomic_load_explicit(&audio->position,
+		    memory_order_relaxed);
+		counter = audio->positionCounter;
+
+		atomic_thread_fence(memory_order_acquire);
+		unsigned int seq2 = atomic_load_explicit(&audio->clockSeq,
+		    memory_order_relaxed);
+		if (seq1 == seq2) {
+			break;
+		}
+	}
+
+	if (pos == 0) {
+		return 0;
+	}
+
+	double buffer = (double)audio->spec.samples / audio->rate;
+	double since = (double)(SDL_GetPerformanceCounter() - counter) /
+	    SDL_GetPerformanceFrequency();
+	if (since > buffer) {
+		since = buffer;
+	}
+
+	double t = (double)pos / audio->rate - buffer + since;
+	return t > 0 ? t : 0;
+}
+
+/*
+ * Copy the most recently published features - this never blocks the analysis
+ * thread and only retries if it raced with a publish.
+ */
+void audioGetFeatures(Audio *audio, AudioFeatures *features) {
+	for (;;) {
+		unsigned int seq1 = atomic_load_explicit(&audio->featuresSeq,
+		    memory_order_acquire);
+		if (seq1 & 1) {
+			continue;
+		}
+
+		*features = audio->features;
+
+		atomic_thread_fence(memory_order_acquire);
+		unsigned int seq2 = atomic_load_explicit(&audio->featuresSeq,
+		    memory_order_relaxed);
+		if (seq1 == seq2) {
+			return;
+		}
+	}
+}
+
+/*
+ * If the whole file has been played
+ */
+bool audioFinished(Audio *audio) {
+	return atomic_load_explicit(&audio->position, memory_order_acquire) >=
+	    audio->frames;
+}
+
+/*
+ * Stop playback and analysis and free everything
+ */
+void audioClose(Audio *audio) {
+	if (audio == NULL) {
+		return;
+	}
+
+	if (audio->device != 0) {
+		SDL_CloseAudioDevice(audio->device);
+	}
+
+	if (audio->threadStarted) {
+		atomic_store(&audio->running, false);
+		pthread_join(audio->thread, NULL);
+	}
+
+	spscDestroy(audio->ring);
+	analyzerDestroy(audio->analyzer);
+	free(audio->mixdown);
+	munmap(audio->map, audio->mapSize);
+	free(audio);
+}
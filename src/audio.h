@@ -0,0 +1,91 @@
+/*
+ * Audio file playback and analysis
+ *
+ * A WAV file is mmap'd and streamed straight to the SDL audio device from the
+ * audio callback, so playback never depends on how quickly frames are drawn.
+ * Everything that is played is also mixed down to mono and pushed into a
+ * lock-free ring buffer that is drained by a separate analysis thread (see
+ * analysis.h) - the render thread only ever reads the published results.
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __APPLE__
+#include <SDL.h>
+#else
+#include <SDL2/SDL.h>
+#endif
+
+#include "analysis.h"
+#include "spsc.h"
+
+// Number of samples the analysis thread processes at a time
+#define AUDIO_HOP_SIZE 1024
+
+// Number of samples (the most recent) used for each hop's FFT
+#define AUDIO_FFT_SIZE 2048
+
+typedef struct Audio {
+	// the mmap'd file
+	void *map;
+	size_t mapSize;
+
+	// PCM data inside the file
+	const unsigned char *data;
+	size_t frames;
+	int channels;
+	int rate;
+	int bytesPerSample;
+	bool isFloat;
+
+	// playback
+	SDL_AudioDeviceID device;
+	SDL_AudioSpec spec;
+	atomic_size_t position;
+	float *mixdown;
+
+	// when (SDL_GetPerformanceCounter()) position was last advanced,
+	// guarded by clockSeq (see audioClock())
+	atomic_uint clockSeq;
+	Uint64 positionCounter;
+
+	// analysis
+	SpscRing *ring;
+	Analyzer *analyzer;
+	pthread_t thread;
+	bool threadStarted;
+	atomic_bool running;
+
+	// samples dropped because the ring was full (analysis too slow)
+	atomic_ulong overflows;
+
+	// times the analysis thread found the ring still empty after waiting a
+	// full hop during playback
+	atomic_ulong underflows;
+
+	// features of the most recently analyzed hop, guarded by a seqlock
+	// (see audioGetFeatures())
+	atomic_uint featuresSeq;
+	AudioFeatures features;
+} Audio;
+
+Audio *audioOpen(const char *path);
+size_t audioReadMono(Audio *audio, size_t start, size_t count, float *out);
+bool audioStart(Audio *audio);
+double audioTime(Audio *audio);
+double audioClock(Audio *audio);
+void audioGetFeatures(Audio *audio, AudioFeatures *features);
+bool audioFinished(Audio *audio);
+void audioClose(Audio *audio);
+
+#endif
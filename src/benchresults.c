@@ -0,0 +1,341 @@
+/*
+ * Benchmark results history
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "benchresults.h"
+
+// set by the Makefile
+#ifndef BUILD_COMMIT
+#define BUILD_COMMIT "unknown"
+#endif
+#ifndef BUILD_CFLAGS
+#define BUILD_CFLAGS "unknown"
+#endif
+
+const char *benchSeriesNames[BENCH_SERIES_COUNT] = {
+	"update",
+	"draw",
+	"lines"
+};
+
+/*
+ * The ISA extensions the compiler was allowed to use
+ */
+static void benchIsa(char *buf, size_t size) {
+	const char *arch = "unknown";
+#if defined(__x86_64__)
+	arch = "x86_64";
+#elif defined(__i386__)
+	arch = "i386";
+#elif defined(__aarch64__)
+	arch = "aarch64";
+#elif defined(__arm__)
+	arch = "arm";
+#endif
+	snprintf(buf, size, "%s%s%s%s%s%s", arch,
+#ifdef __SSE4_2__
+	    " sse4.2",
+#else
+	    "",
+#endif
+#ifdef __AVX__
+	    " avx",
+#else
+	    "",
+#endif
+#ifdef __AVX2__
+	    " avx2",
+#else
+	    "",
+#endif
+#ifdef __FMA__
+	    " fma",
+#else
+	    "",
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	    " neon"
+#else
+	    ""
+#endif
+	    );
+}
+
+/*
+ * CPU model name, from /proc/cpuinfo on Linux
+ */
+static void benchCpu(char *buf, size_t size) {
+	char line[256];
+
+	snprintf(buf, size, "unknown");
+
+	FILE *f = fopen("/proc/cpuinfo", "r");
+	if (f == NULL) {
+		return;
+	}
+	while (fgets(line, sizeof (line), f) != NULL) {
+		char *colon = strchr(line, ':');
+		if (colon == NULL || (strncmp(line, "model name", 10) != 0 &&
+		    strncmp(line, "Model", 5) != 0)) {
+			continue;
+		}
+		colon++;
+		while (*colon == ' ' || *colon == '\t') {
+			colon++;
+		}
+		colon[strcspn(colon, "\n")] = '\0';
+		snprintf(buf, size, "%s", colon);
+		break;
+	}
+	fclose(f);
+}
+
+/*
+ * Set up a result for count frames with this build's and machine's
+ * metadata.  Returns -1 if the samples can't be allocated.
+ */
+int benchResultInit(BenchResult *result, size_t count) {
+	memset(result, 0, sizeof (BenchResult));
+
+	for (int i = 0; i < BENCH_SERIES_COUNT; i++) {
+		result->samples[i] = calloc(count > 0 ? count : 1,
+		    sizeof (double));
+		if (result->samples[i] == NULL) {
+			warn("benchResultInit calloc");
+			benchResultFree(result);
+			return -1;
+		}
+	}
+	result->count = count;
+
+	time_t now = time(NULL);
+	strftime(result->time, sizeof (result->time), "%Y-%m-%dT%H:%M:%SZ",
+	    gmtime(&now));
+	snprintf(result->commit, sizeof (result->commit), "%s", BUILD_COMMIT);
+	snprintf(result->flags, sizeof (result->flags), "%s", BUILD_CFLAGS);
+#ifdef __VERSION__
+	snprintf(result->compiler, sizeof (result->compiler), "%s",
+	    __VERSION__);
+#endif
+	benchCpu(result->cpu, sizeof (result->cpu));
+	benchIsa(result->isa, sizeof (result->isa));
+
+	return 0;
+}
+
+void benchResultFree(BenchResult *result) {
+	for (int i = 0; i < BENCH_SERIES_COUNT; i++) {
+		free(result->samples[i]);
+		result->samples[i] = NULL;
+	}
+	result->count = 0;
+}
+
+static void writeString(FILE *f, const char *key, const char *value) {
+	fprintf(f, "\"%s\":\"", key);
+	for (; *value != '\0'; value++) {
+		if (*value == '"' || *value == '\\') {
+			fputc('\\', f);
+		}
+		fputc(*value, f);
+	}
+	fprintf(f, "\",");
+}
+
+/*
+ * Append a result to the JSON lines file at path.  Returns -1 on error.
+ */
+int benchResultAppend(const char *path, const BenchResult *result) {
+	FILE *f = fopen(path, "a");
+	if (f == NULL) {
+		warn("open %s", path);
+		return -1;
+	}
+
+	fprintf(f, "{");
+	writeString(f, "time", result->time);
+	writeString(f, "commit", result->commit);
+	writeString(f, "compiler", result->compiler);
+	writeString(f, "flags", result->flags);
+	writeString(f, "cpu", result->cpu);
+	writeString(f, "isa", result->isa);
+	fprintf(f, "\"frames\":%d,\"ringCount\":%u,\"particles\":%u",
+	    result->frames, result->ringCount, result->particles);
+	for (int i = 0; i < BENCH_SERIES_COUNT; i++) {
+		fprintf(f, ",\"%s\":[", benchSeriesNames[i]);
+		for (size_t j = 0; j < result->count; j++) {
+			fprintf(f, "%s%.3f", j > 0 ? "," : "",
+			    result->samples[i][j]);
+		}
+		fprintf(f, "]");
+	}
+	fprintf(f, "}\n");
+
+	if (fclose(f) != 0) {
+		warn("write %s", path);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Find "key": in a line, returning what follows the colon
+ */
+static const char *findKey(const char *line, const char *key) {
+	char needle[64];
+	snprintf(needle, sizeof (needle), "\"%s\":", key);
+	const char *p = strstr(line, needle);
+	return p == NULL ? NULL : p + strlen(needle);
+}
+
+static void readString(const char *line, const char *key, char *buf,
+    size_t size) {
+	const char *p = findKey(line, key);
+	size_t n = 0;
+
+	if (p != NULL && *p == '"') {
+		for (p++; *p != '\0' && *p != '"' && n + 1 < size; p++) {
+			if (*p == '\\' && p[1] != '\0') {
+				p++;
+			}
+			buf[n++] = *p;
+		}
+	}
+	buf[n] = '\0';
+}
+
+static long readNumber(const char *line, const char *key) {
+	const char *p = findKey(line, key);
+	return p == NULL ? 0 : strtol(p, NULL, 10);
+}
+
+/*
+ * Count the numbers in the array value of key, and fill out with them if
+ * it's not NULL
+ */
+static size_t readArray(const char *line, const char *key, double *out) {
+	const char *p = findKey(line, key);
+	size_t n = 0;
+
+	if (p == NULL || *p != '[') {
+		return 0;
+	}
+	p++;
+	while (*p != ']' && *p != '\0') {
+		char *end;
+		double value = strtod(p, &end);
+		if (end == p) {
+			break;
+		}
+		if (out != NULL) {
+			out[n] = value;
+		}
+		n++;
+		p = end;
+		if (*p == ',') {
+			p++;
+		}
+	}
+	return n;
+}
+
+/*
+ * Parse one result line from path into result
+ */
+static int benchResultParse(const char *path, const char *line,
+    BenchResult *result) {
+	size_t count = readArray(line, benchSeriesNames[0], NULL);
+	if (benchResultInit(result, count) != 0) {
+		return -1;
+	}
+	for (int i = 0; i < BENCH_SERIES_COUNT; i++) {
+		if (readArray(line, benchSeriesNames[i],
+		    result->samples[i]) != count) {
+			warnx("%s: %s has the wrong number of samples", path,
+			    benchSeriesNames[i]);
+			benchResultFree(result);
+			return -1;
+		}
+	}
+
+	readString(line, "time", result->time, sizeof (result->time));
+	readString(line, "commit", result->commit, sizeof (result->commit));
+	readString(line, "compiler", result->compiler,
+	    sizeof (result->compiler));
+	readString(line, "flags", result->flags, sizeof (result->flags));
+	readString(line, "cpu", result->cpu, sizeof (result->cpu));
+	readString(line, "isa", result->isa, sizeof (result->isa));
+	result->frames = readNumber(line, "frames");
+	result->ringCount = readNumber(line, "ringCount");
+	result->particles = readNumber(line, "particles");
+
+	return 0;
+}
+
+/*
+ * Read the last (up to) max results from the JSON lines file at path into
+ * results, oldest first (free each with benchResultFree()).  Returns how
+ * many were read, or -1 on error or if there are none.
+ */
+int benchResultReadLast(const char *path, BenchResult *results, int max) {
+	char **lines;
+	char *line = NULL;
+	size_t size = 0;
+	int total = 0;
+
+	lines = calloc(max, sizeof (char *));
+	if (lines == NULL) {
+		warn("benchResultReadLast calloc");
+		return -1;
+	}
+
+	FILE *f = fopen(path, "r");
+	if (f == NULL) {
+		warn("open %s", path);
+		free(lines);
+		return -1;
+	}
+	// keep the last max lines, lines[total % max] is the oldest
+	while (getline(&line, &size, f) != -1) {
+		if (line[0] == '{') {
+			free(lines[total % max]);
+			lines[total % max] = strdup(line);
+			total++;
+		}
+	}
+	free(line);
+	fclose(f);
+
+	int n = total < max ? total : max;
+	int ret = n;
+	if (n == 0) {
+		warnx("%s: no results", path);
+		ret = -1;
+	}
+	for (int i = 0; i < n && ret != -1; i++) {
+		const char *l = lines[(total - n + i) % max];
+		if (l == NULL || benchResultParse(path, l, &results[i]) != 0) {
+			while (i-- > 0) {
+				benchResultFree(&results[i]);
+			}
+			ret = -1;
+		}
+	}
+
+	for (int i = 0; i < max; i++) {
+		free(lines[i]);
+	}
+	free(lines);
+	return ret;
+}
@@ -0,0 +1,52 @@
+/*
+ * Benchmark results history
+ *
+ * Every --benchmark run can append a result to a JSON lines file: the
+ * per-frame time of each benchmarked part of a frame plus what is needed to
+ * tell runs apart - the git commit, compiler, flags, CPU model and the ISA
+ * extensions the binary was built for.  bench/benchcompare.c compares the
+ * latest runs against the runs of a baseline.
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#ifndef BENCHRESULTS_H
+#define BENCHRESULTS_H
+
+#include <stddef.h>
+
+enum BenchSeries {
+	BenchUpdate,
+	BenchDraw,
+	BenchLines,
+	BENCH_SERIES_COUNT
+};
+
+extern const char *benchSeriesNames[BENCH_SERIES_COUNT];
+
+typedef struct BenchResult {
+	char time[32];
+	char commit[64];
+	char compiler[128];
+	char flags[256];
+	char cpu[128];
+	char isa[128];
+
+	// the scene that was benchmarked
+	int frames;
+	unsigned int ringCount;
+	unsigned int particles;
+
+	// per-frame times (microseconds) of each series, count of each
+	double *samples[BENCH_SERIES_COUNT];
+	size_t count;
+} BenchResult;
+
+int benchResultInit(BenchResult *result, size_t count);
+void benchResultFree(BenchResult *result);
+int benchResultAppend(const char *path, const BenchResult *result);
+int benchResultReadLast(const char *path, BenchResult *results, int max);
+
+#endif
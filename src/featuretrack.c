@@ -0,0 +1,297 @@
+/*
+ * Precomputed audio feature tracks
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#include <assert.h>
+#include <err.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "featuretrack.h"
+#include "trace.h"
+
+/*
+ * A chunk of video frames analyzed by a single thread
+ */
+typedef struct FeatureTrackChunk {
+	Audio *audio;
+	FeatureTrackFrame *frames;
+	unsigned int fps;
+	unsigned int fftSize;
+	unsigned long first;
+	unsigned long count;
+	int failed;
+} FeatureTrackChunk;
+
+/*
+ * First audio frame (sample) of the given video frame.  Video frames don't
+ * have to line up with samples, so frames are a sample longer or shorter as
+ * needed to never drift.
+ */
+static size_t featureTrackSample(Audio *audio, unsigned int fps,
+    unsigned long frame) {
+
+	return (size_t)((unsigned long long)frame * audio->rate / fps);
+}
+
+/*
+ * Analyze one chunk.  The analyzer is warmed up on the frames before the
+ * chunk first so its window and onset history match a sequential run.
+ */
+static void *featureTrackChunkThread(void *arg) {
+	FeatureTrackChunk *chunk = arg;
+	Audio *audio = chunk->audio;
+	unsigned int fps = chunk->fps;
+
+	traceThreadName("feature-track");
+	TRACE_BEGIN("analyze-chunk");
+
+	Analyzer *analyzer = analyzerCreate(chunk->fftSize, audio->rate);
+	float *hop = malloc(sizeof (float) * chunk->fftSize);
+	if (analyzer == NULL || hop == NULL) {
+		chunk->failed = 1;
+		analyzerDestroy(analyzer);
+		free(hop);
+		return NULL;
+	}
+
+	// enough frames to fill the FFT window and the onset history
+	unsigned long samplesPerFrame = audio->rate / fps + 1;
+	unsigned long preroll = chunk->fftSize / samplesPerFrame + 1 +
+	    ANALYSIS_ONSET_HISTORY;
+	unsigned long start = chunk->first > preroll ?
+	    chunk->first - preroll : 0;
+
+	for (unsigned long f = start; f < chunk->first + chunk->count; f++) {
+		size_t s0 = featureTrackSample(audio, fps, f);
+		size_t s1 = featureTrackSample(audio, fps, f + 1);
+		AudioFeatures features;
+
+		audioReadMono(audio, s0, s1 - s0, hop);
+		analyzerProcess(analyzer, hop, s1 - s0, &features);
+
+		if (f < chunk->first) {
+			continue;
+		}
+
+		FeatureTrackFrame *frame = &chunk->frames[f];
+		frame->level = features.level;
+		memcpy(frame->bands, features.bands, sizeof (frame->bands));
+		frame->flux = features.flux;
+		frame->onset = features.onset;
+	}
+
+	analyzerDestroy(analyzer);
+	free(hop);
+	TRACE_END("analyze-chunk");
+	return NULL;
+}
+
+/*
+ * Analyze the whole audio file at fps video frames per second using the
+ * given number of threads and write the feature track to path.
+ *
+ * Returns 0 on success and -1 (after printing why) on failure.
+ */
+int featureTrackAnalyze(Audio *audio, const char *path, unsigned int fps,
+    unsigned int fftSize, int threads) {
+
+	assert(fps > 0);
+	assert(threads > 0);
+
+	// each frame's hop must fit in the FFT window
+	if (audio->rate / fps + 1 > fftSize) {
+		warnx("fps %u too low for a %u point FFT", fps, fftSize);
+		return -1;
+	}
+
+	unsigned long frameCount = (unsigned long long)audio->frames * fps /
+	    audio->rate + 1;
+	FeatureTrackFrame *frames = calloc(frameCount,
+	    sizeof (FeatureTrackFrame));
+	FeatureTrackChunk *chunks = calloc(threads, sizeof (FeatureTrackChunk));
+	pthread_t *tids = calloc(threads, sizeof (pthread_t));
+	if (frames == NULL || chunks == NULL || tids == NULL) {
+		warn("featureTrackAnalyze calloc");
+		free(frames);
+		free(chunks);
+		free(tids);
+		return -1;
+	}
+
+	// split the frames evenly over the threads
+	unsigned long per = (frameCount + threads - 1) / threads;
+	int started = 0;
+	int ret = 0;
+	for (int i = 0; i < threads; i++) {
+		FeatureTrackChunk *chunk = &chunks[i];
+		chunk->audio = audio;
+		chunk->frames = frames;
+		chunk->fps = fps;
+		chunk->fftSize = fftSize;
+		chunk->first = i * per;
+		if (chunk->first >= frameCount) {
+			break;
+		}
+		chunk->count = frameCount - chunk->first < per ?
+		    frameCount - chunk->first : per;
+
+		int rc = pthread_create(&tids[i], NULL,
+		    featureTrackChunkThread, chunk);
+		if (rc != 0) {
+			warnx("pthread_create: %s", strerror(rc));
+			ret = -1;
+			break;
+		}
+		started++;
+	}
+
+	for (int i = 0; i < started; i++) {
+		pthread_join(tids[i], NULL);
+		if (chunks[i].failed) {
+			warnx("failed to analyze chunk %d", i);
+			ret = -1;
+		}
+	}
+
+	if (ret == 0) {
+		FeatureTrackHeader header;
+		memset(&header, 0, sizeof (header));
+		memcpy(header.magic, FEATURE_TRACK_MAGIC, 4);
+		header.version = FEATURE_TRACK_VERSION;
+		header.fps = fps;
+		header.bands = ANALYSIS_BANDS;
+		header.frameCount = frameCount;
+		header.frameSize = sizeof (FeatureTrackFrame);
+
+		FILE *f = fopen(path, "wb");
+		if (f == NULL) {
+			warn("fopen %s", path);
+			ret = -1;
+		} else {
+			if (fwrite(&header, sizeof (header), 1, f) != 1 ||
+			    fwrite(frames, sizeof (FeatureTrackFrame),
+			    frameCount, f) != frameCount) {
+				warn("write %s", path);
+				ret = -1;
+			}
+			if (fclose(f) != 0) {
+				warn("close %s", path);
+				ret = -1;
+			}
+		}
+	}
+
+	free(frames);
+	free(chunks);
+	free(tids);
+	return ret;
+}
+
+/*
+ * mmap and validate a feature track.
+ *
+ * Returns NULL (after printing why) on failure.  Must be freed by the caller
+ * with featureTrackClose()
+ */
+FeatureTrack *featureTrackOpen(const char *path) {
+	FeatureTrack *track = calloc(1, sizeof (FeatureTrack));
+	if (track == NULL) {
+		warn("featureTrackOpen calloc");
+		return NULL;
+	}
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		warn("open %s", path);
+		free(track);
+		return NULL;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		warn("fstat %s", path);
+		close(fd);
+		free(track);
+		return NULL;
+	}
+
+	track->mapSize = st.st_size;
+	if (track->mapSize < sizeof (FeatureTrackHeader)) {
+		warnx("%s: too small to be a feature track", path);
+		close(fd);
+		free(track);
+		return NULL;
+	}
+
+	track->map = mmap(NULL, track->mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (track->map == MAP_FAILED) {
+		warn("mmap %s", path);
+		free(track);
+		return NULL;
+	}
+
+	const FeatureTrackHeader *header = track->map;
+	size_t expected = sizeof (FeatureTrackHeader) +
+	    (size_t)header->frameCount * sizeof (FeatureTrackFrame);
+	if (memcmp(header->magic, FEATURE_TRACK_MAGIC, 4) != 0 ||
+	    header->version != FEATURE_TRACK_VERSION ||
+	    header->bands != ANALYSIS_BANDS ||
+	    header->frameSize != sizeof (FeatureTrackFrame) ||
+	    header->fps == 0 || header->frameCount == 0 ||
+	    track->mapSize < expected) {
+		warnx("%s: not a compatible feature track", path);
+		munmap(track->map, track->mapSize);
+		free(track);
+		return NULL;
+	}
+
+	track->header = header;
+	track->frames = (const FeatureTrackFrame *)(header + 1);
+
+	return track;
+}
+
+/*
+ * Get the frame for the given time (in seconds), clamped to the track.  The
+ * frame index is stored in idx if it isn't NULL.
+ */
+#define FEATURE_TRACK_EPSILON 1e-6
+const FeatureTrackFrame *featureTrackFrame(FeatureTrack *track, double time,
+    unsigned long *idx) {
+
+	// a time landing exactly on a frame boundary (as virtual time stepped
+	// one frame at a time does) mustn't round down to the frame before
+	double f = time * track->header->fps + FEATURE_TRACK_EPSILON;
+	unsigned long i = f > 0 ? (unsigned long)f : 0;
+	if (i >= track->header->frameCount) {
+		i = track->header->frameCount - 1;
+	}
+
+	if (idx != NULL) {
+		*idx = i;
+	}
+	return &track->frames[i];
+}
+
+/*
+ * Unmap and free a feature track
+ */
+void featureTrackClose(FeatureTrack *track) {
+	if (track == NULL) {
+		return;
+	}
+	munmap(track->map, track->mapSize);
+	free(track);
+}
@@ -0,0 +1,61 @@
+/*
+ * Precomputed audio feature tracks
+ *
+ * A feature track is the analysis (see analysis.h) of an entire audio file
+ * done ahead of time with one record per video frame, so renders can look up
+ * the features for any frame in O(1) instead of analyzing audio as they go -
+ * at any speed and starting from any frame.  Tracks are written by
+ * featureTrackAnalyze(), which splits the file into chunks analyzed in
+ * parallel, and read back with mmap.
+ *
+ * File layout (native byte order): a FeatureTrackHeader followed by
+ * frameCount FeatureTrackFrame records.
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#ifndef FEATURETRACK_H
+#define FEATURETRACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "analysis.h"
+#include "audio.h"
+
+#define FEATURE_TRACK_MAGIC "UCFT"
+#define FEATURE_TRACK_VERSION 1
+
+typedef struct FeatureTrackHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t fps;
+	uint32_t bands;
+	uint32_t frameCount;
+	uint32_t frameSize;
+} FeatureTrackHeader;
+
+typedef struct FeatureTrackFrame {
+	float level;
+	float bands[ANALYSIS_BANDS];
+	float flux;
+	uint32_t onset;
+} FeatureTrackFrame;
+
+typedef struct FeatureTrack {
+	void *map;
+	size_t mapSize;
+	const FeatureTrackHeader *header;
+	const FeatureTrackFrame *frames;
+} FeatureTrack;
+
+int featureTrackAnalyze(Audio *audio, const char *path, unsigned int fps,
+    unsigned int fftSize, int threads);
+FeatureTrack *featureTrackOpen(const char *path);
+const FeatureTrackFrame *featureTrackFrame(FeatureTrack *track, double time,
+    unsigned long *idx);
+void featureTrackClose(FeatureTrack *track);
+
+#endif
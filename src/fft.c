@@ -0,0 +1,206 @@
+/*
+ * A small real-input FFT
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "fft.h"
+
+/*
+ * Create an FFT for n real points.
+ *
+ * Returns NULL if n isn't a power of 2 (of at least 8) or allocation fails.
+ * Must be freed by the caller with fftDestroy()
+ */
+FFT *fftCreate(unsigned int n) {
+	if (n < 8 || (n & (n - 1)) != 0) {
+		return NULL;
+	}
+
+	FFT *fft = calloc(1, sizeof (FFT));
+	if (fft == NULL) {
+		return NULL;
+	}
+
+	unsigned int m = n / 2;
+	fft->n = n;
+	fft->m = m;
+	fft->bitrev = malloc(sizeof (unsigned int) * m);
+	fft->twRe = malloc(sizeof (float) * m);
+	fft->twIm = malloc(sizeof (float) * m);
+	fft->splitRe = malloc(sizeof (float) * m);
+	fft->splitIm = malloc(sizeof (float) * m);
+	fft->window = malloc(sizeof (float) * n);
+	fft->re = malloc(sizeof (float) * m);
+	fft->im = malloc(sizeof (float) * m);
+
+	if (fft->bitrev == NULL || fft->twRe == NULL || fft->twIm == NULL ||
+	    fft->splitRe == NULL || fft->splitIm == NULL ||
+	    fft->window == NULL || fft->re == NULL || fft->im == NULL) {
+		fftDestroy(fft);
+		return NULL;
+	}
+
+	// bit reversal permutation for m points
+	unsigned int bits = 0;
+	while ((1u << bits) < m) {
+		bits++;
+	}
+	for (unsigned int i = 0; i < m; i++) {
+		unsigned int r = 0;
+		for (unsigned int b = 0; b < bits; b++) {
+			if (i & (1u << b)) {
+				r |= 1u << (bits - 1 - b);
+			}
+		}
+		fft->bitrev[i] = r;
+	}
+
+	// twiddles for each stage, stored contiguously per stage
+	for (unsigned int span = 2; span <= m; span *= 2) {
+		unsigned int half = span / 2;
+		for (unsigned int k = 0; k < half; k++) {
+			double angle = -2.0 * M_PI * k / span;
+			fft->twRe[half + k] = cos(angle);
+			fft->twIm[half + k] = sin(angle);
+		}
+	}
+
+	// twiddles for splitting the complex result into the real spectrum
+	for (unsigned int k = 0; k < m; k++) {
+		double angle = -2.0 * M_PI * k / n;
+		fft->splitRe[k] = cos(angle);
+		fft->splitIm[k] = sin(angle);
+	}
+
+	// Hann window
+	fft->windowSum = 0;
+	for (unsigned int i = 0; i < n; i++) {
+		fft->window[i] = 0.5 - 0.5 * cos(2.0 * M_PI * i / n);
+		fft->windowSum += fft->window[i];
+	}
+
+	return fft;
+}
+
+/*
+ * In-place iterative complex FFT of fft->m points (already in bit reversed
+ * order).  The first two stages need no multiplications and are done together
+ * as a single radix-4 pass.
+ */
+static void fftComplex(FFT *fft) {
+	float *restrict re = fft->re;
+	float *restrict im = fft->im;
+	unsigned int m = fft->m;
+
+	// spans 2 and 4
+	for (unsigned int i = 0; i < m; i += 4) {
+		float ar = re[i] + re[i + 1], ai = im[i] + im[i + 1];
+		float br = re[i] - re[i + 1], bi = im[i] - im[i + 1];
+		float cr = re[i + 2] + re[i + 3], ci = im[i + 2] + im[i + 3];
+		float dr = re[i + 2] - re[i + 3], di = im[i + 2] - im[i + 3];
+
+		re[i] = ar + cr;
+		im[i] = ai + ci;
+		re[i + 2] = ar - cr;
+		im[i + 2] = ai - ci;
+
+		// d * -i
+		re[i + 1] = br + di;
+		im[i + 1] = bi - dr;
+		re[i + 3] = br - di;
+		im[i + 3] = bi + dr;
+	}
+
+	// remaining radix-2 stages
+	for (unsigned int span = 8; span <= m; span *= 2) {
+		unsigned int half = span / 2;
+		const float *restrict wr = fft->twRe + half;
+		const float *restrict wi = fft->twIm + half;
+
+		for (unsigned int i = 0; i < m; i += span) {
+			float *restrict xr = re + i;
+			float *restrict xi = im + i;
+			float *restrict yr = re + i + half;
+			float *restrict yi = im + i + half;
+
+			for (unsigned int k = 0; k < half; k++) {
+				float tr = yr[k] * wr[k] - yi[k] * wi[k];
+				float ti = yr[k] * wi[k] + yi[k] * wr[k];
+
+				yr[k] = xr[k] - tr;
+				yi[k] = xi[k] - ti;
+				xr[k] = xr[k] + tr;
+				xi[k] = xi[k] + ti;
+			}
+		}
+	}
+}
+
+/*
+ * Window the n real samples in "in" and calculate their power spectrum into
+ * "power" (n / 2 + 1 bins).  The power is normalized so a full scale sine
+ * wave centered on a bin has a power of 1.
+ */
+void fftPowerSpectrum(FFT *fft, const float *in, float *power) {
+	unsigned int m = fft->m;
+	float *re = fft->re;
+	float *im = fft->im;
+
+	// pack even samples as real and odd samples as imaginary
+	for (unsigned int i = 0; i < m; i++) {
+		unsigned int j = fft->bitrev[i];
+		re[j] = in[2 * i] * fft->window[2 * i];
+		im[j] = in[2 * i + 1] * fft->window[2 * i + 1];
+	}
+
+	fftComplex(fft);
+
+	float scale = 2.0f / fft->windowSum;
+	scale *= scale;
+
+	// DC and nyquist
+	power[0] = (re[0] + im[0]) * (re[0] + im[0]) * scale / 4;
+	power[m] = (re[0] - im[0]) * (re[0] - im[0]) * scale / 4;
+
+	// split Z into the spectrum X of the real input
+	for (unsigned int k = 1; k < m; k++) {
+		float zr = re[k], zi = im[k];
+		float cr = re[m - k], ci = -im[m - k];
+
+		// even part (Z[k] + conj(Z[m - k])) / 2
+		float er = (zr + cr) / 2, ei = (zi + ci) / 2;
+
+		// odd part (Z[k] - conj(Z[m - k])) / 2i
+		float or = (zi - ci) / 2, oi = -(zr - cr) / 2;
+
+		float xr = er + or * fft->splitRe[k] - oi * fft->splitIm[k];
+		float xi = ei + or * fft->splitIm[k] + oi * fft->splitRe[k];
+
+		power[k] = (xr * xr + xi * xi) * scale;
+	}
+}
+
+/*
+ * Free an FFT
+ */
+void fftDestroy(FFT *fft) {
+	if (fft == NULL) {
+		return;
+	}
+	free(fft->bitrev);
+	free(fft->twRe);
+	free(fft->twIm);
+	free(fft->splitRe);
+	free(fft->splitIm);
+	free(fft->window);
+	free(fft->re);
+	free(fft->im);
+	free(fft);
+}
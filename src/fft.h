@@ -0,0 +1,49 @@
+/*
+ * A small real-input FFT
+ *
+ * The real FFT of n points is done as a complex FFT of n / 2 points followed
+ * by a split step.  Everything that only depends on n (bit reversal, twiddle
+ * factors and the window) is precomputed by fftCreate(), and the complex data
+ * is kept as separate real and imaginary arrays with the twiddles for each
+ * stage stored contiguously so the butterfly loops vectorize.
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#ifndef FFT_H
+#define FFT_H
+
+typedef struct FFT {
+	// number of real input points (a power of 2, at least 8)
+	unsigned int n;
+
+	// size of the complex FFT (n / 2)
+	unsigned int m;
+
+	// bit reversal permutation (m entries)
+	unsigned int *bitrev;
+
+	// per-stage twiddles, stage with span s starts at offset s / 2
+	float *twRe;
+	float *twIm;
+
+	// split step twiddles e^(-2 pi i k / n) (m entries)
+	float *splitRe;
+	float *splitIm;
+
+	// Hann window (n entries) and its sum
+	float *window;
+	float windowSum;
+
+	// work space (m entries each)
+	float *re;
+	float *im;
+} FFT;
+
+FFT *fftCreate(unsigned int n);
+void fftPowerSpectrum(FFT *fft, const float *in, float *power);
+void fftDestroy(FFT *fft);
+
+#endif
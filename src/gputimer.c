@@ -0,0 +1,123 @@
+/*
+ * GPU pass timing with timer queries
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#include <err.h>
+#include <stdlib.h>
+
+#include "gputimer.h"
+
+/*
+ * Create the queries for every frame in flight.
+ *
+ * Returns NULL (after printing why) if the driver doesn't support timer
+ * queries - everything else keeps working without GPU times.
+ */
+GpuTimer *gpuTimerCreate() {
+	if (!SDL_GL_ExtensionSupported("GL_ARB_timer_query")) {
+		warnx("GL_ARB_timer_query not supported, no GPU timing");
+		return NULL;
+	}
+
+	GpuTimer *timer = calloc(1, sizeof (GpuTimer));
+	if (timer == NULL) {
+		warn("gpuTimerCreate malloc");
+		return NULL;
+	}
+
+	timer->genQueries = SDL_GL_GetProcAddress("glGenQueries");
+	timer->deleteQueries = SDL_GL_GetProcAddress("glDeleteQueries");
+	timer->beginQuery = SDL_GL_GetProcAddress("glBeginQuery");
+	timer->endQuery = SDL_GL_GetProcAddress("glEndQuery");
+	timer->getQueryObjectiv = SDL_GL_GetProcAddress("glGetQueryObjectiv");
+	timer->getQueryObjectui64v =
+	    SDL_GL_GetProcAddress("glGetQueryObjectui64v");
+	if (timer->genQueries == NULL || timer->deleteQueries == NULL ||
+	    timer->beginQuery == NULL || timer->endQuery == NULL ||
+	    timer->getQueryObjectiv == NULL ||
+	    timer->getQueryObjectui64v == NULL) {
+		warnx("timer query functions missing, no GPU timing");
+		free(timer);
+		return NULL;
+	}
+
+	timer->genQueries(GPU_TIMER_FRAMES * GPU_PASS_COUNT,
+	    &timer->queries[0][0]);
+
+	return timer;
+}
+
+/*
+ * Start a new frame, reusing the queries of the oldest frame in flight.
+ *
+ * Returns true and fills ms with the time (in milliseconds) each pass of
+ * that frame took on the GPU if all of its results are ready.  Passes that
+ * weren't drawn are 0.
+ */
+bool gpuTimerFrameBegin(GpuTimer *timer, double ms[GPU_PASS_COUNT]) {
+	if (timer == NULL) {
+		return false;
+	}
+
+	timer->frame = (timer->frame + 1) % GPU_TIMER_FRAMES;
+	bool *issued = timer->issued[timer->frame];
+	GLuint *queries = timer->queries[timer->frame];
+
+	// drop the whole frame rather than wait for a query still running
+	bool ready = false;
+	for (int i = 0; i < GPU_PASS_COUNT; i++) {
+		if (!issued[i]) {
+			continue;
+		}
+
+		GLint available = 0;
+		timer->getQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE,
+		    &available);
+		if (!available) {
+			ready = false;
+			break;
+		}
+		ready = true;
+	}
+
+	for (int i = 0; i < GPU_PASS_COUNT; i++) {
+		ms[i] = 0;
+		if (ready && issued[i]) {
+			GLuint64 ns;
+			timer->getQueryObjectui64v(queries[i], GL_QUERY_RESULT,
+			    &ns);
+			ms[i] = ns / 1e6;
+		}
+		issued[i] = false;
+	}
+
+	return ready;
+}
+
+void gpuTimerBegin(GpuTimer *timer, enum ProfilerGpuPass pass) {
+	if (timer == NULL) {
+		return;
+	}
+	timer->beginQuery(GL_TIME_ELAPSED, timer->queries[timer->frame][pass]);
+}
+
+void gpuTimerEnd(GpuTimer *timer, enum ProfilerGpuPass pass) {
+	if (timer == NULL) {
+		return;
+	}
+	timer->endQuery(GL_TIME_ELAPSED);
+	timer->issued[timer->frame][pass] = true;
+}
+
+void gpuTimerDestroy(GpuTimer *timer) {
+	if (timer == NULL) {
+		return;
+	}
+	timer->deleteQueries(GPU_TIMER_FRAMES * GPU_PASS_COUNT,
+	    &timer->queries[0][0]);
+	free(timer);
+}
@@ -0,0 +1,56 @@
+/*
+ * GPU pass timing with timer queries
+ *
+ * A GL_TIME_ELAPSED query is wrapped around each pass (see
+ * ProfilerGpuPass).  Queries are only read back GPU_TIMER_FRAMES frames
+ * after they were issued, by which time the GPU has almost always finished
+ * with them, so reading the results never stalls the pipeline.
+ *
+ * Passes can't overlap: a pass must end before the next one begins.
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+
+#include <stdbool.h>
+
+#ifdef __APPLE__
+#include <SDL.h>
+#include <SDL_opengl.h>
+#else
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_opengl.h>
+#endif
+
+#include "profiler.h"
+
+// Frames of queries in flight
+#define GPU_TIMER_FRAMES 4
+
+typedef struct GpuTimer {
+	GLuint queries[GPU_TIMER_FRAMES][GPU_PASS_COUNT];
+	bool issued[GPU_TIMER_FRAMES][GPU_PASS_COUNT];
+
+	// slot of the frame being recorded
+	int frame;
+
+	// timer query entry points (ARB_timer_query / GL 3.3)
+	PFNGLGENQUERIESPROC genQueries;
+	PFNGLDELETEQUERIESPROC deleteQueries;
+	PFNGLBEGINQUERYPROC beginQuery;
+	PFNGLENDQUERYPROC endQuery;
+	PFNGLGETQUERYOBJECTIVPROC getQueryObjectiv;
+	PFNGLGETQUERYOBJECTUI64VPROC getQueryObjectui64v;
+} GpuTimer;
+
+GpuTimer *gpuTimerCreate();
+bool gpuTimerFrameBegin(GpuTimer *timer, double ms[GPU_PASS_COUNT]);
+void gpuTimerBegin(GpuTimer *timer, enum ProfilerGpuPass pass);
+void gpuTimerEnd(GpuTimer *timer, enum ProfilerGpuPass pass);
+void gpuTimerDestroy(GpuTimer *timer);
+
+#endif
@@ -0,0 +1,264 @@
+/*
+ * On-screen performance HUD
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#include <ctype.h>
+#include <err.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __APPLE__
+#include <SDL_opengl.h>
+#else
+#include <GL/gl.h>
+#endif
+
+#include "hud.h"
+
+// Size (in screen pixels) of a single font pixel
+#define HUD_SCALE 2
+
+// Font glyph size and spacing (in font pixels)
+#define HUD_GLYPH_WIDTH 3
+#define HUD_GLYPH_HEIGHT 5
+#define HUD_ADVANCE 4
+#define HUD_LINE_HEIGHT 7
+
+// Layout (in screen pixels)
+#define HUD_PADDING 6
+#define HUD_WIDTH (HUD_PADDING * 2 + HUD_HISTORY * 2)
+#define HUD_GRAPH_HEIGHT 60
+#define HUD_BAR_X 110
+#define HUD_BAR_HEIGHT 8
+
+// Frame time at the top of the graph and at the end of a phase bar (ms)
+#define HUD_GRAPH_MAXIMUM 50.0
+#define HUD_BUDGET (1000.0 / 60.0)
+
+/*
+ * 3x5 font for ASCII 32 (' ') through 95 ('_'), lower case is drawn as
+ * upper case and anything missing as '?'.  Each glyph is 5 rows of 3 bits
+ * (the top row in the highest bits, the left column in the highest bit of
+ * each row).
+ */
+static const unsigned short font[64] = {
+	0x0000, 0x7282, 0x7282, 0x7282,  //   ! " #
+	0x7282, 0x52a5, 0x7282, 0x7282,  // $ % & '
+	0x2922, 0x224a, 0x7282, 0x05d0,  // ( ) * +
+	0x0014, 0x01c0, 0x0002, 0x12a4,  // , - . /
+	0x7b6f, 0x2c97, 0x73e7, 0x72cf,  // 0 1 2 3
+	0x5bc9, 0x79cf, 0x79ef, 0x7292,  // 4 5 6 7
+	0x7bef, 0x7bcf, 0x0410, 0x7282,  // 8 9 : ;
+	0x7282, 0x0e38, 0x7282, 0x7282,  // < = > ?
+	0x7282, 0x2bed, 0x6bae, 0x3923,  // @ A B C
+	0x6b6e, 0x79a7, 0x79a4, 0x396b,  // D E F G
+	0x5bed, 0x7497, 0x126a, 0x5bad,  // H I J K
+	0x4927, 0x5fed, 0x6b6d, 0x2b6a,  // L M N O
+	0x6ba4, 0x2b73, 0x6bad, 0x388e,  // P Q R S
+	0x7492, 0x5b6f, 0x5b6a, 0x5bfd,  // T U V W
+	0x5aad, 0x5a92, 0x72a7, 0x7282,  // X Y Z [
+	0x7282, 0x7282, 0x7282, 0x0007,  // \\ ] ^ _
+};
+
+static const unsigned char colorPanel[4] = { 0, 0, 0, 255 };
+static const unsigned char colorText[4] = { 230, 230, 230, 255 };
+static const unsigned char colorGrid[4] = { 90, 90, 90, 255 };
+static const unsigned char colorGood[4] = { 80, 220, 80, 255 };
+static const unsigned char colorSlow[4] = { 230, 200, 50, 255 };
+static const unsigned char colorBad[4] = { 230, 60, 60, 255 };
+static const unsigned char colorPhases[PHASE_COUNT][4] = {
+	{ 200, 120, 220, 255 },
+	{ 120, 120, 120, 255 },
+	{ 80, 160, 240, 255 },
+	{ 80, 220, 180, 255 },
+	{ 240, 110, 150, 255 },
+	{ 220, 220, 220, 255 },
+	{ 240, 160, 80, 255 }
+};
+
+Hud *hudCreate() {
+	Hud *hud = calloc(1, sizeof (Hud));
+	if (hud == NULL) {
+		warn("hudCreate malloc");
+		return NULL;
+	}
+
+	hud->vertices = malloc(sizeof (HudVertex) * 4 * HUD_MAX_QUADS);
+	if (hud->vertices == NULL) {
+		warn("hudCreate malloc");
+		free(hud);
+		return NULL;
+	}
+
+	return hud;
+}
+
+/*
+ * Add the last complete frame to the graph
+ */
+void hudRecordFrame(Hud *hud, const ProfilerFrame *frame) {
+	hud->history[hud->historyIdx] = frame->frameTime;
+	hud->historyIdx = (hud->historyIdx + 1) % HUD_HISTORY;
+
+	for (int i = 0; i < PHASE_COUNT; i++) {
+		hud->phases[i] = frame->phases[i];
+	}
+}
+
+static void hudQuad(Hud *hud, float x, float y, float w, float h,
+    const unsigned char rgba[4]) {
+
+	if (hud->numVertices + 4 > HUD_MAX_QUADS * 4) {
+		return;
+	}
+
+	float xs[4] = { x, x + w, x + w, x };
+	float ys[4] = { y, y, y + h, y + h };
+	for (int i = 0; i < 4; i++) {
+		HudVertex *v = &hud->vertices[hud->numVertices++];
+		v->x = xs[i];
+		v->y = ys[i];
+		v->rgba[0] = rgba[0];
+		v->rgba[1] = rgba[1];
+		v->rgba[2] = rgba[2];
+		v->rgba[3] = rgba[3];
+	}
+}
+
+/*
+ * Add text with its top left corner at x, y - each run of lit pixels in a
+ * glyph row is a single quad.
+ */
+static void hudText(Hud *hud, float x, float y, const char *s,
+    const unsigned char rgba[4]) {
+
+	for (; *s != '\0'; s++, x += HUD_ADVANCE * HUD_SCALE) {
+		int c = toupper((unsigned char)*s);
+		if (c < 32 || c > 95) {
+			c = '?';
+		}
+		unsigned short glyph = font[c - 32];
+
+		for (int row = 0; row < HUD_GLYPH_HEIGHT; row++) {
+			int bits = (glyph >> ((HUD_GLYPH_HEIGHT - 1 - row) *
+			    HUD_GLYPH_WIDTH)) & 0x7;
+
+			int col = 0;
+			while (col < HUD_GLYPH_WIDTH) {
+				if (!(bits & (4 >> col))) {
+					col++;
+					continue;
+				}
+				int start = col;
+				while (col < HUD_GLYPH_WIDTH &&
+				    (bits & (4 >> col))) {
+					col++;
+				}
+				hudQuad(hud, x + start * HUD_SCALE,
+				    y + row * HUD_SCALE,
+				    (col - start) * HUD_SCALE, HUD_SCALE, rgba);
+			}
+		}
+	}
+}
+
+/*
+ * Start building a new HUD - the first quad is reserved for the background
+ * panel (sized in hudEnd()).
+ */
+void hudBegin(Hud *hud) {
+	hud->numVertices = 0;
+	hud->cursorY = HUD_PADDING;
+	hudQuad(hud, 0, 0, 0, 0, colorPanel);
+}
+
+/*
+ * Add a line of text below the previous one
+ */
+void hudPrintf(Hud *hud, const char *fmt, ...) {
+	char buf[HUD_WIDTH / (HUD_ADVANCE * HUD_SCALE) + 1];
+	va_list args;
+
+	va_start(args, fmt);
+	vsnprintf(buf, sizeof (buf), fmt, args);
+	va_end(args);
+
+	hudText(hud, HUD_PADDING, hud->cursorY, buf, colorText);
+	hud->cursorY += HUD_LINE_HEIGHT * HUD_SCALE;
+}
+
+static const unsigned char *hudFrameColor(float ms) {
+	if (ms <= HUD_BUDGET * 1.05) {
+		return colorGood;
+	} else if (ms <= HUD_BUDGET * 2.05) {
+		return colorSlow;
+	}
+	return colorBad;
+}
+
+/*
+ * Add the frame-time graph and phase bars, then draw the whole HUD
+ */
+void hudEnd(Hud *hud) {
+	char buf[32];
+	float x = HUD_PADDING;
+	float y = hud->cursorY + HUD_PADDING;
+
+	// frame-time graph (oldest on the left) with a line at the budget
+	float bottom = y + HUD_GRAPH_HEIGHT;
+	float budgetY = bottom - HUD_BUDGET / HUD_GRAPH_MAXIMUM *
+	    HUD_GRAPH_HEIGHT;
+	hudQuad(hud, x, budgetY, HUD_HISTORY * 2, 1, colorGrid);
+	for (int i = 0; i < HUD_HISTORY; i++) {
+		float ms = hud->history[(hud->historyIdx + i) % HUD_HISTORY];
+		float h = ms / HUD_GRAPH_MAXIMUM * HUD_GRAPH_HEIGHT;
+		if (h > HUD_GRAPH_HEIGHT) {
+			h = HUD_GRAPH_HEIGHT;
+		}
+		hudQuad(hud, x + i * 2, bottom - h, 2, h, hudFrameColor(ms));
+	}
+	y = bottom + HUD_PADDING;
+
+	// one bar per phase, full width is the whole frame budget
+	for (int i = 0; i < PHASE_COUNT; i++) {
+		snprintf(buf, sizeof (buf), "%-6s %6.2f", profilerPhaseNames[i],
+		    hud->phases[i]);
+		hudText(hud, x, y, buf, colorText);
+
+		float w = hud->phases[i] / HUD_BUDGET *
+		    (HUD_WIDTH - HUD_BAR_X - HUD_PADDING);
+		if (w > HUD_WIDTH - HUD_BAR_X - HUD_PADDING) {
+			w = HUD_WIDTH - HUD_BAR_X - HUD_PADDING;
+		}
+		hudQuad(hud, HUD_BAR_X, y, w < 1 ? 1 : w, HUD_BAR_HEIGHT,
+		    colorPhases[i]);
+		y += HUD_LINE_HEIGHT * HUD_SCALE;
+	}
+
+	// now the size of the panel is known
+	HudVertex *panel = hud->vertices;
+	panel[1].x = panel[2].x = HUD_WIDTH;
+	panel[2].y = panel[3].y = y + HUD_PADDING - HUD_SCALE * 2;
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glVertexPointer(2, GL_FLOAT, sizeof (HudVertex), &hud->vertices[0].x);
+	glColorPointer(4, GL_UNSIGNED_BYTE, sizeof (HudVertex),
+	    hud->vertices[0].rgba);
+	glDrawArrays(GL_QUADS, 0, hud->numVertices);
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+void hudDestroy(Hud *hud) {
+	if (hud == NULL) {
+		return;
+	}
+	free(hud->vertices);
+	free(hud);
+}
@@ -0,0 +1,60 @@
+/*
+ * On-screen performance HUD
+ *
+ * Every frame the HUD is built into a single array of colored quads -
+ * a background panel, text from a tiny embedded 3x5 bitmap font, a
+ * scrolling frame-time graph and a bar for each main-loop phase - which is
+ * then submitted with one glDrawArrays() call.
+ *
+ * Usage:
+ *
+ *   hudRecordFrame(hud, profilerLastFrame());   // once per frame
+ *   hudBegin(hud);
+ *   hudPrintf(hud, "rings=%u", ringCount);      // any number of lines
+ *   hudEnd(hud);                                // graph, bars and draw
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#ifndef HUD_H
+#define HUD_H
+
+#include "profiler.h"
+
+// Frames shown in the frame-time graph
+#define HUD_HISTORY 120
+
+// Most quads (text pixel runs, bars...) a single HUD can hold
+#define HUD_MAX_QUADS 4096
+
+typedef struct HudVertex {
+	float x;
+	float y;
+	unsigned char rgba[4];
+} HudVertex;
+
+typedef struct Hud {
+	// frame times (ms), history[historyIdx] is the oldest
+	float history[HUD_HISTORY];
+	int historyIdx;
+
+	// phase times of the last frame recorded
+	double phases[PHASE_COUNT];
+
+	// vertices of the HUD being built
+	HudVertex *vertices;
+	int numVertices;
+	float cursorY;
+} Hud;
+
+Hud *hudCreate();
+void hudRecordFrame(Hud *hud, const ProfilerFrame *frame);
+void hudBegin(Hud *hud);
+void hudPrintf(Hud *hud, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+void hudEnd(Hud *hud);
+void hudDestroy(Hud *hud);
+
+#endif
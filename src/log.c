@@ -0,0 +1,207 @@
+/*
+ * Non-blocking logger
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#include <err.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "log.h"
+#include "spsc.h"
+#include "realtime.h"
+#include "trace.h"
+
+// Messages written per wakeup of the writer thread
+#define LOG_BATCH 64
+
+// How long the writer sleeps when there is nothing to write
+#define LOG_SLEEP_MS 5
+
+typedef struct LogMessage {
+	FILE *stream;
+	unsigned int length;
+	char text[LOG_MESSAGE_SIZE];
+} LogMessage;
+
+static SpscRing *ring = NULL;
+static pthread_t thread;
+static atomic_bool running = false;
+
+// messages that didn't fit in the ring, and how many of those were reported
+static atomic_ulong dropped = 0;
+static unsigned long droppedReported = 0;
+
+/*
+ * Write a batch of messages, flushing each stream once at the end
+ */
+static void logWrite(LogMessage *messages, size_t n) {
+	bool flushOut = false;
+	bool flushErr = false;
+
+	for (size_t i = 0; i < n; i++) {
+		fwrite(messages[i].text, 1, messages[i].length,
+		    messages[i].stream);
+		if (messages[i].stream == stdout) {
+			flushOut = true;
+		} else if (messages[i].stream == stderr) {
+			flushErr = true;
+		} else {
+			fflush(messages[i].stream);
+		}
+	}
+
+	if (flushOut) {
+		fflush(stdout);
+	}
+	if (flushErr) {
+		fflush(stderr);
+	}
+}
+
+/*
+ * Report any messages dropped since the last report
+ */
+static void logReportDropped() {
+	unsigned long n = atomic_load_explicit(&dropped, memory_order_relaxed);
+	if (n != droppedReported) {
+		fprintf(stderr, "[warn] log: %lu messages dropped\n",
+		    n - droppedReported);
+		droppedReported = n;
+	}
+}
+
+/*
+ * Write everything queued, returns the number of messages written
+ */
+static size_t logDrain() {
+	LogMessage batch[LOG_BATCH];
+	size_t total = 0;
+	size_t n;
+
+	while ((n = spscPop(ring, batch, LOG_BATCH)) > 0) {
+		TRACE_BEGIN("log-write");
+		logWrite(batch, n);
+		TRACE_END("log-write");
+		total += n;
+	}
+	logReportDropped();
+
+	return total;
+}
+
+static void *logThread(void *arg) {
+	struct timespec sleep = { 0, LOG_SLEEP_MS * 1000000L };
+
+	traceThreadName("log-writer");
+	realtimeWorkerThread();
+
+	while (atomic_load(&running)) {
+		if (logDrain() == 0) {
+			nanosleep(&sleep, NULL);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Start the writer thread.
+ *
+ * Returns -1 (after printing why) on failure, messages are still written
+ * directly in that case.
+ */
+int logStart() {
+	if (atomic_load(&running)) {
+		return 0;
+	}
+
+	ring = spscCreate(sizeof (LogMessage), LOG_RING_MESSAGES);
+	if (ring == NULL) {
+		warn("logStart spscCreate");
+		return -1;
+	}
+
+	atomic_store(&running, true);
+	int ret = pthread_create(&thread, NULL, logThread, NULL);
+	if (ret != 0) {
+		warnx("pthread_create: %s", strerror(ret));
+		atomic_store(&running, false);
+		spscDestroy(ring);
+		ring = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Like fprintf(), but never blocks once the logger is started
+ */
+void logPrintf(FILE *stream, const char *fmt, ...) {
+	va_list args;
+
+	va_start(args, fmt);
+	if (!atomic_load_explicit(&running, memory_order_relaxed)) {
+		vfprintf(stream, fmt, args);
+		va_end(args);
+		return;
+	}
+
+	LogMessage message;
+	int length = vsnprintf(message.text, sizeof (message.text), fmt,
+	    args);
+	va_end(args);
+
+	if (length < 0) {
+		return;
+	}
+	if (length >= (int)sizeof (message.text)) {
+		// truncated - keep the line ending if there was one
+		length = sizeof (message.text) - 1;
+		size_t n = strlen(fmt);
+		if (n > 0 && fmt[n - 1] == '\n') {
+			message.text[length - 1] = '\n';
+		}
+	}
+	message.stream = stream;
+	message.length = length;
+
+	if (spscPush(ring, &message, 1) == 0) {
+		atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+	}
+}
+
+/*
+ * Messages dropped because the writer fell behind
+ */
+unsigned long logDropped() {
+	return atomic_load_explicit(&dropped, memory_order_relaxed);
+}
+
+/*
+ * Write everything queued and stop the writer thread - safe to call more
+ * than once (and without logStart())
+ */
+void logStop() {
+	if (!atomic_load(&running)) {
+		return;
+	}
+
+	atomic_store(&running, false);
+	pthread_join(thread, NULL);
+
+	// anything queued after the writer's last pass
+	logDrain();
+
+	spscDestroy(ring);
+	ring = NULL;
+}
@@ -0,0 +1,36 @@
+/*
+ * Non-blocking logger
+ *
+ * Once started with logStart(), logPrintf() formats the message on the
+ * calling thread and queues it on a lock-free ring buffer - a background
+ * thread does the actual (possibly blocking) writes.  If the writer falls
+ * behind and the ring fills up, messages are dropped and counted rather than
+ * stalling the caller.  Before logStart() (and after logStop()) messages are
+ * written directly.
+ *
+ * Only one thread (the render thread) may call logPrintf() while the logger
+ * is running.
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdio.h>
+
+// Longest message (anything longer is truncated)
+#define LOG_MESSAGE_SIZE 240
+
+// Messages that can be queued before the writer falls behind
+#define LOG_RING_MESSAGES 1024
+
+int logStart();
+void logPrintf(FILE *stream, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+unsigned long logDropped();
+void logStop();
+
+#endif
@@ -0,0 +1,297 @@
+/*
+ * Per-frame metrics stream
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#include <err.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "metrics.h"
+#include "realtime.h"
+#include "trace.h"
+
+// Records written per wakeup of the writer thread
+#define METRICS_BATCH 256
+
+// How long the writer sleeps when there is nothing to write
+#define METRICS_SLEEP_MS 10
+
+// stdio buffer for the output file
+#define METRICS_FILE_BUFFER (256 * 1024)
+
+enum MetricsColumnType {
+	ColumnDouble,
+	ColumnUint,
+	ColumnUlong
+};
+
+typedef struct MetricsColumn {
+	const char *name;
+	enum MetricsColumnType type;
+	size_t offset;
+} MetricsColumn;
+
+#define COLUMN(name, type, field) { name, type, offsetof(MetricsRecord, field) }
+
+/*
+ * Every column in output order (rss is sampled by the writer and always
+ * comes last)
+ */
+static const MetricsColumn columns[] = {
+	COLUMN("timestamp", ColumnDouble, timestamp),
+	COLUMN("frameTime", ColumnDouble, frameTime),
+	COLUMN("events", ColumnDouble, phases[PhaseEvents]),
+	COLUMN("clear", ColumnDouble, phases[PhaseClear]),
+	COLUMN("update", ColumnDouble, phases[PhaseUpdate]),
+	COLUMN("draw", ColumnDouble, phases[PhaseDraw]),
+	COLUMN("lines", ColumnDouble, phases[PhaseLines]),
+	COLUMN("hud", ColumnDouble, phases[PhaseHud]),
+	COLUMN("swap", ColumnDouble, phases[PhaseSwap]),
+	COLUMN("ringCount", ColumnUint, ringCount),
+	COLUMN("particleCount", ColumnUint, particleCount),
+	COLUMN("recycledParticles", ColumnUint, recycledParticles),
+	COLUMN("born", ColumnUint, born),
+	COLUMN("pairsTested", ColumnUint, pairsTested),
+	COLUMN("linesDrawn", ColumnUint, linesDrawn),
+	COLUMN("drawCalls", ColumnUlong, counts[CounterDrawCalls]),
+	COLUMN("vertices", ColumnUlong, counts[CounterVertices]),
+	COLUMN("stateChanges", ColumnUlong, counts[CounterStateChanges]),
+	COLUMN("particlesAllocs", ColumnUlong, allocs[AllocParticles]),
+	COLUMN("particlesAllocBytes", ColumnUlong, allocBytes[AllocParticles]),
+	COLUMN("particlesLive", ColumnUlong, live[AllocParticles]),
+	COLUMN("particleNodesAllocs", ColumnUlong, allocs[AllocParticleNodes]),
+	COLUMN("particleNodesAllocBytes", ColumnUlong,
+	    allocBytes[AllocParticleNodes]),
+	COLUMN("particleNodesLive", ColumnUlong, live[AllocParticleNodes]),
+	COLUMN("ringsAllocs", ColumnUlong, allocs[AllocRings]),
+	COLUMN("ringsAllocBytes", ColumnUlong, allocBytes[AllocRings]),
+	COLUMN("ringsLive", ColumnUlong, live[AllocRings]),
+	COLUMN("colorsAllocs", ColumnUlong, allocs[AllocColors]),
+	COLUMN("colorsAllocBytes", ColumnUlong, allocBytes[AllocColors]),
+	COLUMN("colorsLive", ColumnUlong, live[AllocColors]),
+	COLUMN("gpuFade", ColumnDouble, gpu[GpuPassFade]),
+	COLUMN("gpuParticles", ColumnDouble, gpu[GpuPassParticles]),
+	COLUMN("gpuLines", ColumnDouble, gpu[GpuPassLines]),
+	COLUMN("overdraw", ColumnUlong, overdraw),
+	COLUMN("overdrawP99", ColumnUint, overdrawP99),
+};
+#define NUM_COLUMNS (sizeof (columns) / sizeof (columns[0]))
+
+/*
+ * Resident set size of this process in KiB.  /proc is Linux only, elsewhere
+ * the peak RSS from getrusage() is the best available.
+ */
+unsigned long metricsRss() {
+	static long pageKb = 0;
+	unsigned long size, resident;
+
+	if (pageKb == 0) {
+		pageKb = sysconf(_SC_PAGESIZE) / 1024;
+	}
+
+	FILE *f = fopen("/proc/self/statm", "r");
+	if (f != NULL) {
+		int n = fscanf(f, "%lu %lu", &size, &resident);
+		fclose(f);
+		if (n == 2) {
+			return resident * pageKb;
+		}
+	}
+
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+		// bytes on macOS
+		return usage.ru_maxrss / 1024;
+#else
+		return usage.ru_maxrss;
+#endif
+	}
+	return 0;
+}
+
+static void metricsWriteHeader(Metrics *metrics) {
+	if (metrics->json) {
+		return;
+	}
+
+	for (size_t i = 0; i < NUM_COLUMNS; i++) {
+		fprintf(metrics->file, "%s,", columns[i].name);
+	}
+	fprintf(metrics->file, "rss\n");
+}
+
+static void metricsWriteRecord(Metrics *metrics, const MetricsRecord *record,
+    unsigned long rss) {
+
+	const char *base = (const char *)record;
+	FILE *f = metrics->file;
+
+	if (metrics->json) {
+		fputc('{', f);
+	}
+	for (size_t i = 0; i < NUM_COLUMNS; i++) {
+		const MetricsColumn *c = &columns[i];
+
+		if (metrics->json) {
+			fprintf(f, "\"%s\":", c->name);
+		}
+		switch (c->type) {
+		case ColumnDouble:
+			fprintf(f, "%.4f", *(const double *)(base + c->offset));
+			break;
+		case ColumnUint:
+			fprintf(f, "%u",
+			    *(const unsigned int *)(base + c->offset));
+			break;
+		case ColumnUlong:
+			fprintf(f, "%lu",
+			    *(const unsigned long *)(base + c->offset));
+			break;
+		}
+		fputc(',', f);
+	}
+	if (metrics->json) {
+		fprintf(f, "\"rss\":%lu}\n", rss);
+	} else {
+		fprintf(f, "%lu\n", rss);
+	}
+}
+
+/*
+ * Drain the ring, returns the number of records written
+ */
+static size_t metricsDrain(Metrics *metrics) {
+	MetricsRecord batch[METRICS_BATCH];
+	size_t total = 0;
+	size_t n;
+
+	while ((n = spscPop(metrics->ring, batch, METRICS_BATCH)) > 0) {
+		// one sample per batch - a batch covers a few frames at most
+		unsigned long rss = metricsRss();
+
+		TRACE_BEGIN("metrics-write");
+		for (size_t i = 0; i < n; i++) {
+			metricsWriteRecord(metrics, &batch[i], rss);
+		}
+		TRACE_END("metrics-write");
+		total += n;
+	}
+
+	metrics->written += total;
+	return total;
+}
+
+static void *metricsThread(void *arg) {
+	Metrics *metrics = arg;
+	struct timespec sleep = { 0, METRICS_SLEEP_MS * 1000000L };
+
+	traceThreadName("metrics-writer");
+	realtimeWorkerThread();
+
+	while (atomic_load(&metrics->running)) {
+		if (metricsDrain(metrics) == 0) {
+			nanosleep(&sleep, NULL);
+		}
+	}
+
+	// anything queued before metricsClose()
+	metricsDrain(metrics);
+
+	return NULL;
+}
+
+/*
+ * Open the metrics file and start the writer thread.
+ *
+ * Returns NULL (after printing why) on failure.
+ */
+Metrics *metricsOpen(const char *path) {
+	Metrics *metrics = calloc(1, sizeof (Metrics));
+	if (metrics == NULL) {
+		warn("metricsOpen malloc");
+		return NULL;
+	}
+
+	const char *ext = strrchr(path, '.');
+	metrics->json = ext != NULL &&
+	    (strcmp(ext, ".json") == 0 || strcmp(ext, ".jsonl") == 0);
+
+	metrics->file = fopen(path, "w");
+	if (metrics->file == NULL) {
+		warn("fopen %s", path);
+		free(metrics);
+		return NULL;
+	}
+	setvbuf(metrics->file, NULL, _IOFBF, METRICS_FILE_BUFFER);
+
+	metrics->ring = spscCreate(sizeof (MetricsRecord),
+	    METRICS_RING_RECORDS);
+	if (metrics->ring == NULL) {
+		warn("metricsOpen spscCreate");
+		fclose(metrics->file);
+		free(metrics);
+		return NULL;
+	}
+
+	metricsWriteHeader(metrics);
+
+	atomic_store(&metrics->running, true);
+	int ret = pthread_create(&metrics->thread, NULL, metricsThread,
+	    metrics);
+	if (ret != 0) {
+		warnx("pthread_create: %s", strerror(ret));
+		spscDestroy(metrics->ring);
+		fclose(metrics->file);
+		free(metrics);
+		return NULL;
+	}
+
+	return metrics;
+}
+
+/*
+ * Queue a record to be written - this never blocks, if the writer has fallen
+ * behind the record is dropped and counted.
+ */
+void metricsRecord(Metrics *metrics, const MetricsRecord *record) {
+	if (spscPush(metrics->ring, record, 1) == 0) {
+		atomic_fetch_add_explicit(&metrics->dropped, 1,
+		    memory_order_relaxed);
+	}
+}
+
+/*
+ * Write everything queued, stop the writer thread and close the file
+ */
+void metricsClose(Metrics *metrics) {
+	if (metrics == NULL) {
+		return;
+	}
+
+	atomic_store(&metrics->running, false);
+	pthread_join(metrics->thread, NULL);
+
+	unsigned long dropped = atomic_load(&metrics->dropped);
+	if (dropped > 0) {
+		warnx("metrics: %lu records dropped (writer fell behind)",
+		    dropped);
+	}
+
+	if (fclose(metrics->file) != 0) {
+		warn("metrics fclose");
+	}
+	spscDestroy(metrics->ring);
+	free(metrics);
+}
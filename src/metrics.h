@@ -0,0 +1,83 @@
+/*
+ * Per-frame metrics stream
+ *
+ * The render thread hands one fixed-size MetricsRecord per frame to
+ * metricsRecord(), which never blocks - records are queued on a ring buffer
+ * and a background thread formats and writes them.  The output is CSV, or
+ * JSON lines if the file name ends in ".json" or ".jsonl".
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "alloc.h"
+#include "profiler.h"
+#include "spsc.h"
+
+// Records that can be queued before the writer falls behind
+#define METRICS_RING_RECORDS 4096
+
+typedef struct MetricsRecord {
+	// simulation time (seconds)
+	double timestamp;
+
+	// frame and phase times (milliseconds)
+	double frameTime;
+	double phases[PHASE_COUNT];
+
+	// scene state at the end of the frame
+	unsigned int ringCount;
+	unsigned int particleCount;
+	unsigned int recycledParticles;
+
+	// work done during the frame
+	unsigned int born;
+	unsigned int pairsTested;
+	unsigned int linesDrawn;
+
+	// GL work submitted during the frame
+	unsigned long counts[COUNTER_COUNT];
+
+	// allocations and bytes allocated this frame and live objects, by
+	// subsystem
+	unsigned long allocs[ALLOC_SUBSYSTEM_COUNT];
+	unsigned long allocBytes[ALLOC_SUBSYSTEM_COUNT];
+	unsigned long live[ALLOC_SUBSYSTEM_COUNT];
+
+	// the latest GPU pass times (milliseconds)
+	double gpu[GPU_PASS_COUNT];
+
+	// fragments drawn and their 99th percentile per pixel (overdraw
+	// mode only)
+	unsigned long overdraw;
+	unsigned int overdrawP99;
+} MetricsRecord;
+
+typedef struct Metrics {
+	FILE *file;
+	bool json;
+
+	SpscRing *ring;
+	pthread_t thread;
+	atomic_bool running;
+
+	// records that didn't fit in the ring
+	atomic_ulong dropped;
+	unsigned long written;
+} Metrics;
+
+Metrics *metricsOpen(const char *path);
+void metricsRecord(Metrics *metrics, const MetricsRecord *record);
+void metricsClose(Metrics *metrics);
+unsigned long metricsRss();
+
+#endif
@@ -0,0 +1,230 @@
+/*
+ * Overdraw (fill-rate) diagnostic
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#include <err.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "overdraw.h"
+
+/*
+ * Heatmap stops on a log2 scale: 0 is black, then 1, 2, 4, ... 128+
+ * fragments go from dark blue through cyan, green, yellow and red to white.
+ */
+static const float heatmapStops[][3] = {
+	{ 0.0, 0.0, 0.3 },
+	{ 0.0, 0.0, 1.0 },
+	{ 0.0, 1.0, 1.0 },
+	{ 0.0, 1.0, 0.0 },
+	{ 1.0, 1.0, 0.0 },
+	{ 1.0, 0.5, 0.0 },
+	{ 1.0, 0.0, 0.0 },
+	{ 1.0, 0.0, 1.0 },
+	{ 1.0, 1.0, 1.0 }
+};
+#define NUM_HEATMAP_STOPS (sizeof (heatmapStops) / sizeof (heatmapStops[0]))
+
+/*
+ * Create the overdraw counter.  This needs the GL context to exist.
+ *
+ * Returns NULL if the allocation fails.  A driver without float framebuffers
+ * still gets an Overdraw, its overdrawBegin() just always fails.
+ */
+Overdraw *overdrawCreate() {
+	Overdraw *od = calloc(1, sizeof (Overdraw));
+	if (od == NULL) {
+		warn("overdrawCreate malloc");
+		return NULL;
+	}
+
+	for (int i = 1; i <= OVERDRAW_PALETTE_MAXIMUM; i++) {
+		float t = log2f(i);
+		unsigned int stop = t;
+		if (stop >= NUM_HEATMAP_STOPS - 1) {
+			stop = NUM_HEATMAP_STOPS - 2;
+		}
+		float f = t - stop;
+		if (f > 1) {
+			f = 1;
+		}
+
+		for (int c = 0; c < 3; c++) {
+			float from = heatmapStops[stop][c];
+			float to = heatmapStops[stop + 1][c];
+			od->palette[i][c] = (from + f * (to - from)) * 255;
+		}
+	}
+
+	if (!SDL_GL_ExtensionSupported("GL_ARB_framebuffer_object") ||
+	    !SDL_GL_ExtensionSupported("GL_ARB_texture_float") ||
+	    !SDL_GL_ExtensionSupported("GL_ARB_texture_rg")) {
+		warnx("float framebuffers not supported, no overdraw heatmap");
+		return od;
+	}
+
+	od->genFramebuffers = SDL_GL_GetProcAddress("glGenFramebuffers");
+	od->deleteFramebuffers = SDL_GL_GetProcAddress("glDeleteFramebuffers");
+	od->bindFramebuffer = SDL_GL_GetProcAddress("glBindFramebuffer");
+	od->framebufferTexture2D =
+	    SDL_GL_GetProcAddress("glFramebufferTexture2D");
+	od->checkFramebufferStatus =
+	    SDL_GL_GetProcAddress("glCheckFramebufferStatus");
+	if (od->genFramebuffers == NULL || od->deleteFramebuffers == NULL ||
+	    od->bindFramebuffer == NULL || od->framebufferTexture2D == NULL ||
+	    od->checkFramebufferStatus == NULL) {
+		warnx("framebuffer functions missing, no overdraw heatmap");
+		return od;
+	}
+
+	od->genFramebuffers(1, &od->framebuffer);
+	glGenTextures(1, &od->texture);
+	od->supported = true;
+
+	return od;
+}
+
+/*
+ * (Re)size the framebuffer and the buffers the counts are read into.
+ * Returns -1 (after printing why) on failure.
+ */
+static int overdrawResize(Overdraw *od, int width, int height) {
+	size_t pixels = (size_t)width * height;
+
+	float *counts = realloc(od->counts, pixels * sizeof (float));
+	if (counts != NULL) {
+		od->counts = counts;
+	}
+	unsigned char *heatmap = realloc(od->heatmap, pixels * 3);
+	if (heatmap != NULL) {
+		od->heatmap = heatmap;
+	}
+	if (counts == NULL || heatmap == NULL) {
+		warn("overdrawResize realloc");
+		od->width = od->height = 0;
+		return -1;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, od->texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED,
+	    GL_FLOAT, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	od->bindFramebuffer(GL_FRAMEBUFFER, od->framebuffer);
+	od->framebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+	    GL_TEXTURE_2D, od->texture, 0);
+	GLenum status = od->checkFramebufferStatus(GL_FRAMEBUFFER);
+	od->bindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		warnx("overdraw framebuffer incomplete (0x%x)", status);
+		od->width = od->height = 0;
+		return -1;
+	}
+
+	od->width = width;
+	od->height = height;
+	return 0;
+}
+
+/*
+ * Start counting: switch drawing to the (cleared) count framebuffer and to
+ * additive blending.  Until overdrawEnd() everything must be drawn in
+ * OVERDRAW_UNIT.
+ *
+ * Returns -1 (and draws to the window as usual) if the framebuffer isn't
+ * supported or can't be sized to width x height.
+ */
+int overdrawBegin(Overdraw *od, int width, int height) {
+	if (!od->supported) {
+		return -1;
+	}
+	if ((width != od->width || height != od->height) &&
+	    overdrawResize(od, width, height) != 0) {
+		return -1;
+	}
+
+	od->bindFramebuffer(GL_FRAMEBUFFER, od->framebuffer);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glBlendFunc(GL_ONE, GL_ONE);
+
+	return 0;
+}
+
+/*
+ * Stop counting: read the counts back, summarize them and draw the heatmap
+ * over the frame in the window.
+ */
+void overdrawEnd(Overdraw *od) {
+	int width = od->width;
+	int height = od->height;
+	size_t pixels = (size_t)width * height;
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RED, GL_FLOAT, od->counts);
+	od->bindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	memset(od->histogram, 0, sizeof (od->histogram));
+	unsigned long long total = 0;
+	unsigned int maximum = 0;
+	for (size_t i = 0; i < pixels; i++) {
+		unsigned int count = od->counts[i] + 0.5f;
+		total += count;
+		if (count > maximum) {
+			maximum = count;
+		}
+		od->histogram[count < OVERDRAW_MAXIMUM ? count :
+		    OVERDRAW_MAXIMUM]++;
+
+		unsigned int color = count < OVERDRAW_PALETTE_MAXIMUM ?
+		    count : OVERDRAW_PALETTE_MAXIMUM;
+		unsigned char *rgb = &od->heatmap[i * 3];
+		rgb[0] = od->palette[color][0];
+		rgb[1] = od->palette[color][1];
+		rgb[2] = od->palette[color][2];
+	}
+
+	od->total = total;
+	od->maximum = maximum;
+	od->saturated = od->histogram[OVERDRAW_MAXIMUM];
+	od->p99 = 0;
+
+	unsigned long target = pixels * 0.99;
+	unsigned long seen = 0;
+	for (unsigned int i = 0; i <= OVERDRAW_MAXIMUM && seen <= target;
+	    i++) {
+		if (od->histogram[i] == 0) {
+			continue;
+		}
+		od->p99 = i;
+		seen += od->histogram[i];
+	}
+
+	// the projection is flipped (0 at the top), rows are read bottom up
+	glDisable(GL_BLEND);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glRasterPos2i(0, height);
+	glDrawPixels(width, height, GL_RGB, GL_UNSIGNED_BYTE, od->heatmap);
+	glEnable(GL_BLEND);
+}
+
+void overdrawDestroy(Overdraw *od) {
+	if (od == NULL) {
+		return;
+	}
+	if (od->supported) {
+		od->deleteFramebuffers(1, &od->framebuffer);
+		glDeleteTextures(1, &od->texture);
+	}
+	free(od->counts);
+	free(od->heatmap);
+	free(od);
+}
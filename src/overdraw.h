@@ -0,0 +1,83 @@
+/*
+ * Overdraw (fill-rate) diagnostic
+ *
+ * While counting, everything is drawn additively (GL_ONE, GL_ONE) in
+ * OVERDRAW_UNIT into an offscreen framebuffer with a single float channel
+ * (GL_R32F), so every fragment adds exactly 1 to the pixel it lands on.
+ * Float is used rather than an integer format because integer targets
+ * can't be blended; a float holds every count up to 2^24 exactly.  At the
+ * end of the frame the counts are read back, summarized (total fragments,
+ * 99th percentile and maximum per pixel) and drawn over the frame as a
+ * heatmap.
+ *
+ * The framebuffer needs GL_ARB_framebuffer_object, GL_ARB_texture_float and
+ * GL_ARB_texture_rg - without them overdrawBegin() fails and the mode is
+ * unavailable.  Reading the counts back stalls the pipeline - this is a
+ * diagnostic mode only.
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#ifndef OVERDRAW_H
+#define OVERDRAW_H
+
+#include <stdbool.h>
+
+#ifdef __APPLE__
+#include <SDL.h>
+#include <SDL_opengl.h>
+#else
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_opengl.h>
+#endif
+
+// The color that adds exactly one count to a pixel
+#define OVERDRAW_UNIT 1.0f
+
+// Highest count the percentile histogram tells apart, pixels above it are
+// counted as saturated (the total and maximum are still exact)
+#define OVERDRAW_MAXIMUM 65535
+
+// Counts at and above this share the last heatmap color
+#define OVERDRAW_PALETTE_MAXIMUM 255
+
+typedef struct Overdraw {
+	// the framebuffer counted into and its size
+	bool supported;
+	GLuint framebuffer;
+	GLuint texture;
+	int width;
+	int height;
+
+	// per-pixel counts read back and the heatmap drawn from them
+	float *counts;
+	unsigned char *heatmap;
+
+	// heatmap color of every count
+	unsigned char palette[OVERDRAW_PALETTE_MAXIMUM + 1][3];
+
+	// how many pixels had each count this frame
+	unsigned long histogram[OVERDRAW_MAXIMUM + 1];
+
+	// results of the last frame
+	unsigned long long total;
+	unsigned int p99;
+	unsigned int maximum;
+	unsigned long saturated;
+
+	// framebuffer object entry points (ARB_framebuffer_object / GL 3.0)
+	PFNGLGENFRAMEBUFFERSPROC genFramebuffers;
+	PFNGLDELETEFRAMEBUFFERSPROC deleteFramebuffers;
+	PFNGLBINDFRAMEBUFFERPROC bindFramebuffer;
+	PFNGLFRAMEBUFFERTEXTURE2DPROC framebufferTexture2D;
+	PFNGLCHECKFRAMEBUFFERSTATUSPROC checkFramebufferStatus;
+} Overdraw;
+
+Overdraw *overdrawCreate();
+int overdrawBegin(Overdraw *od, int width, int height);
+void overdrawEnd(Overdraw *od);
+void overdrawDestroy(Overdraw *od);
+
+#endif
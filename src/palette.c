@@ -0,0 +1,122 @@
+/*
+ * Precomputed color tables for the rainbow indexes
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+
+#include "palette.h"
+
+/*
+ * Generate an RGB color from a given index.
+ *
+ * adapted from
+ * https://community.khronos.org/t/a/76562/14
+ */
+RGB rainbow(unsigned int idx) {
+	assert(idx >= 0);
+	assert(idx < MAX_COLORS);
+
+	RGB rgb;
+	float a, b, c;
+
+        unsigned int which = idx / 256;
+        float t = (float)(idx % 256) / 256.0;
+
+        switch (which) {
+        case 0: a =  1; b = t,  c =   0; break; // r->y
+        case 1: a =1-t; b = 1,  c =   0; break; // y->g
+        case 2: a =  0; b = 1,  c =   t; break; // g->c
+        case 3: a =  0; b =1-t, c =   1; break; // c->b
+        case 4: a =  t; b = 0,  c =   1; break; // b->m
+        case 5: a =  1; b = 0,  c = 1-t; break; // m->r
+	default: assert(false);
+	}
+
+	rgb.r = a;
+	rgb.g = b;
+	rgb.b = c;
+
+	return rgb;
+}
+
+/*
+ * Fill every entry of the palette from a compiled magic table
+ */
+void paletteFill(Palette *palette, const RYBPalette *rybPalette) {
+	for (unsigned int i = 0; i < MAX_COLORS; i++) {
+		RGB rgb = rainbow(i);
+		palette->colors[i] = rybPaletteEval(rybPalette, rgb.r, rgb.g,
+		    rgb.b);
+	}
+}
+
+/*
+ * Fill every entry of the palette from a color cube
+ */
+void paletteFillFromCube(Palette *palette, const RYBCube *cube) {
+	for (unsigned int i = 0; i < MAX_COLORS; i++) {
+		RGB rgb = rainbow(i);
+		palette->colors[i] = rybCubeLookup(cube, rgb.r, rgb.g, rgb.b);
+	}
+}
+
+/*
+ * out = from + t * (to - from) for every channel of every entry.  The tables
+ * are walked as flat float arrays so the loop vectorizes.
+ */
+void paletteBlend(Palette *out, const Palette *from, const Palette *to,
+    float t) {
+
+	float *o = (float *)out->colors;
+	const float *f = (const float *)from->colors;
+	const float *d = (const float *)to->colors;
+
+	for (unsigned int i = 0; i < MAX_COLORS * 3; i++) {
+		o[i] = f[i] + t * (d[i] - f[i]);
+	}
+}
+
+/*
+ * Start fading to the given palette over duration milliseconds (0 to switch
+ * immediately).  If a fade is already in progress, the colors currently on
+ * screen become the starting point so overlapping fades never cost more than
+ * a single one.
+ */
+void paletteFadeStart(PaletteFade *fade, const Palette *to, unsigned int
+    duration) {
+
+	fade->from = fade->current;
+	fade->to = *to;
+	fade->elapsed = 0;
+	fade->duration = duration;
+	fade->active = duration > 0;
+
+	if (!fade->active) {
+		fade->current = *to;
+	}
+}
+
+/*
+ * Advance the fade by delta milliseconds - this should be called once per
+ * frame and does nothing if no fade is in progress.
+ */
+void paletteFadeUpdate(PaletteFade *fade, unsigned int delta) {
+	if (!fade->active) {
+		return;
+	}
+
+	fade->elapsed += delta;
+	if (fade->elapsed >= fade->duration) {
+		fade->current = fade->to;
+		fade->active = false;
+		return;
+	}
+
+	paletteBlend(&fade->current, &fade->from, &fade->to,
+	    (float)fade->elapsed / (float)fade->duration);
+}
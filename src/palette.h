@@ -0,0 +1,51 @@
+/*
+ * Precomputed color tables for the rainbow indexes
+ *
+ * A Palette holds the final color for every rainbow index (see rainbow()) for
+ * a given magic table, so coloring a particle costs a single table lookup.
+ * Palettes can be crossfaded with a PaletteFade, which blends the whole table
+ * once per frame.
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <stdbool.h>
+
+#include "ryb2rgb.h"
+
+#define MAX_COLORS (256 * 6)
+
+typedef struct Palette {
+	RGB colors[MAX_COLORS];
+} Palette;
+
+/*
+ * A (possibly in progress) crossfade between two palettes.  "current" is
+ * always the palette that should be drawn with.
+ */
+typedef struct PaletteFade {
+	Palette from;
+	Palette to;
+	Palette current;
+	unsigned int elapsed;
+	unsigned int duration;
+	bool active;
+} PaletteFade;
+
+RGB rainbow(unsigned int idx);
+
+void paletteFill(Palette *palette, const RYBPalette *rybPalette);
+void paletteFillFromCube(Palette *palette, const RYBCube *cube);
+void paletteBlend(Palette *out, const Palette *from, const Palette *to,
+    float t);
+
+void paletteFadeStart(PaletteFade *fade, const Palette *to, unsigned int
+    duration);
+void paletteFadeUpdate(PaletteFade *fade, unsigned int delta);
+
+#endif
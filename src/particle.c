@@ -59,6 +59,8 @@ void particlePrint(Particle *p) {
 void particleCalculateCoordinates(Particle *p) {
 	while (p->position >= 360.0) { p->position -= 360.0; }
 	while (p->position < 0) { p->position += 360.0; }
+	// a tiny negative position + 360 can round up to exactly 360
+	if (p->position >= 360.0) { p->position = 0; }
 	assert(p->position >= 0);
 	assert(p->position < 360.0);
 
@@ -0,0 +1,188 @@
+/*
+ * Hardware performance counters (Linux only)
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "perfcounters.h"
+
+const char *perfCounterNames[PERF_COUNTER_COUNT] = {
+	"cycles",
+	"instructions",
+	"cacheMisses",
+	"branchMisses"
+};
+
+#ifdef __linux__
+
+static const uint64_t perfConfigs[PERF_COUNTER_COUNT] = {
+	PERF_COUNT_HW_CPU_CYCLES,
+	PERF_COUNT_HW_INSTRUCTIONS,
+	PERF_COUNT_HW_CACHE_MISSES,
+	PERF_COUNT_HW_BRANCH_MISSES
+};
+
+/*
+ * The calling thread's group: fds of the counters that opened (the first
+ * one open is the leader) and where each counter is in a group read.
+ */
+static _Thread_local int fds[PERF_COUNTER_COUNT] = { -1, -1, -1, -1 };
+static _Thread_local int leader = -1;
+static _Thread_local int slots[PERF_COUNTER_COUNT];
+static _Thread_local int numOpen = 0;
+
+static int perfEventOpen(struct perf_event_attr *attr, int group) {
+	// this thread, any cpu
+	return syscall(SYS_perf_event_open, attr, 0, -1, group, 0);
+}
+
+static void perfExplain(int e) {
+	if (e != EACCES && e != EPERM) {
+		warnx("perf_event_open: %s", strerror(e));
+		return;
+	}
+
+	int paranoid = -1;
+	FILE *f = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+	if (f != NULL) {
+		if (fscanf(f, "%d", &paranoid) != 1) {
+			paranoid = -1;
+		}
+		fclose(f);
+	}
+	warnx("perf_event_open: %s (perf_event_paranoid=%d, needs 2 or "
+	    "lower), no hardware counters", strerror(e), paranoid);
+}
+
+/*
+ * Open the counter group for the calling thread.
+ *
+ * Returns -1 (after printing why) if no counters could be opened.
+ */
+int perfCountersOpen() {
+	int e = 0;
+
+	if (leader != -1) {
+		return 0;
+	}
+
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof (attr));
+		attr.size = sizeof (attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = perfConfigs[i];
+		attr.read_format = PERF_FORMAT_GROUP;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.disabled = leader == -1;
+
+		int fd = perfEventOpen(&attr, leader);
+		if (fd == -1) {
+			if (leader == -1 && (errno == EACCES ||
+			    errno == EPERM)) {
+				// nothing else will open either
+				perfExplain(errno);
+				return -1;
+			}
+			e = errno;
+			continue;
+		}
+
+		if (leader == -1) {
+			leader = fd;
+		}
+		fds[i] = fd;
+		slots[i] = numOpen++;
+	}
+
+	if (leader == -1) {
+		warnx("perf_event_open: %s, no hardware counters",
+		    strerror(e));
+		return -1;
+	}
+
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+		if (fds[i] == -1) {
+			warnx("%s counter not available, skipping",
+			    perfCounterNames[i]);
+		}
+	}
+
+	ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+	return 0;
+}
+
+bool perfCountersAvailable(enum PerfCounter counter) {
+	return fds[counter] != -1;
+}
+
+/*
+ * Read every counter of the calling thread's group, counters that aren't
+ * available are 0.  Returns false if the group isn't open.
+ */
+bool perfCountersRead(uint64_t values[PERF_COUNTER_COUNT]) {
+	// nr followed by one value per counter
+	uint64_t buf[1 + PERF_COUNTER_COUNT];
+
+	if (leader == -1) {
+		return false;
+	}
+
+	ssize_t n = read(leader, buf, sizeof (uint64_t) * (1 + numOpen));
+	if (n != (ssize_t)(sizeof (uint64_t) * (1 + numOpen))) {
+		return false;
+	}
+
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+		values[i] = fds[i] == -1 ? 0 : buf[1 + slots[i]];
+	}
+	return true;
+}
+
+void perfCountersClose() {
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+		if (fds[i] != -1) {
+			close(fds[i]);
+			fds[i] = -1;
+		}
+	}
+	leader = -1;
+	numOpen = 0;
+}
+
+#else
+
+int perfCountersOpen() {
+	warnx("hardware counters are only supported on Linux");
+	return -1;
+}
+
+bool perfCountersAvailable(enum PerfCounter counter) {
+	return false;
+}
+
+bool perfCountersRead(uint64_t values[PERF_COUNTER_COUNT]) {
+	return false;
+}
+
+void perfCountersClose() {
+}
+
+#endif
@@ -0,0 +1,37 @@
+/*
+ * Hardware performance counters (Linux only)
+ *
+ * perfCountersOpen() opens a perf_event_open(2) counter group for the
+ * calling thread; perfCountersRead() then reads every counter of the group
+ * at once.  Only user-space events are counted, which perf_event_paranoid
+ * allows up to level 2.  Counters the CPU (or VM) doesn't provide are
+ * skipped, and if the group can't be opened at all the reason is printed
+ * and everything else keeps working.
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum PerfCounter {
+	PerfCycles,
+	PerfInstructions,
+	PerfCacheMisses,
+	PerfBranchMisses,
+	PERF_COUNTER_COUNT
+};
+
+extern const char *perfCounterNames[PERF_COUNTER_COUNT];
+
+int perfCountersOpen();
+bool perfCountersAvailable(enum PerfCounter counter);
+bool perfCountersRead(uint64_t values[PERF_COUNTER_COUNT]);
+void perfCountersClose();
+
+#endif
@@ -0,0 +1,300 @@
+/*
+ * Per-frame phase timing
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "perfcounters.h"
+#include "profiler.h"
+#include "trace.h"
+
+const char *profilerPhaseNames[PHASE_COUNT] = {
+	"events",
+	"clear",
+	"update",
+	"draw",
+	"lines",
+	"hud",
+	"swap"
+};
+
+const char *profilerGpuPassNames[GPU_PASS_COUNT] = {
+	"gpuFade",
+	"gpuParticles",
+	"gpuLines"
+};
+
+const char *profilerCounterNames[COUNTER_COUNT] = {
+	"drawCalls",
+	"vertices",
+	"stateChanges"
+};
+
+/*
+ * Histogram of times (in milliseconds) with fixed size buckets, anything
+ * over the range lands in the last bucket.
+ */
+typedef struct ProfilerHistogram {
+	unsigned long counts[PROFILER_BUCKETS];
+	unsigned long total;
+	double max;
+	double sum;
+} ProfilerHistogram;
+
+// the frame being timed and the last complete frame
+static ProfilerFrame current;
+static ProfilerFrame last;
+static double phaseStart[PHASE_COUNT];
+static unsigned long frames = 0;
+
+static ProfilerHistogram frameHistogram;
+static ProfilerHistogram jitterHistogram;
+static ProfilerHistogram phaseHistograms[PHASE_COUNT];
+static ProfilerHistogram gpuHistograms[GPU_PASS_COUNT];
+
+// per-frame counter totals and maximums (frames are in frameHistogram)
+static unsigned long long counterSums[COUNTER_COUNT];
+static unsigned long counterMaximums[COUNTER_COUNT];
+
+// the latest GPU times, carried from frame to frame
+static double gpuLatest[GPU_PASS_COUNT];
+
+// hardware counters at the start of each phase and their totals per phase
+static bool perfEnabled = false;
+static uint64_t perfStart[PHASE_COUNT][PERF_COUNTER_COUNT];
+static uint64_t perfTotals[PHASE_COUNT][PERF_COUNTER_COUNT];
+
+static double profilerNow() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void histogramAdd(ProfilerHistogram *h, double ms) {
+	unsigned int bucket = ms / PROFILER_BUCKET_MS;
+	if (bucket >= PROFILER_BUCKETS) {
+		bucket = PROFILER_BUCKETS - 1;
+	}
+	h->counts[bucket]++;
+	h->total++;
+	h->sum += ms;
+	if (ms > h->max) {
+		h->max = ms;
+	}
+}
+
+/*
+ * Upper bound (in milliseconds) of the bucket holding the given percentile
+ */
+static double histogramPercentile(ProfilerHistogram *h, double p) {
+	unsigned long target = h->total * p / 100.0;
+	unsigned long seen = 0;
+
+	for (unsigned int i = 0; i < PROFILER_BUCKETS; i++) {
+		seen += h->counts[i];
+		if (seen > target) {
+			double upper = (i + 1) * PROFILER_BUCKET_MS;
+			return upper < h->max ? upper : h->max;
+		}
+	}
+	return h->max;
+}
+
+/*
+ * Mark the start of a new frame - this completes the previous frame
+ */
+void profilerFrameBegin() {
+	double now = profilerNow();
+
+	if (frames > 0) {
+		current.frameTime = (now - current.start) * 1000.0;
+		histogramAdd(&frameHistogram, current.frameTime);
+		if (frames > 1) {
+			histogramAdd(&jitterHistogram,
+			    fabs(current.frameTime - last.frameTime));
+		}
+		for (int i = 0; i < PHASE_COUNT; i++) {
+			histogramAdd(&phaseHistograms[i], current.phases[i]);
+		}
+		for (int i = 0; i < COUNTER_COUNT; i++) {
+			counterSums[i] += current.counts[i];
+			if (current.counts[i] > counterMaximums[i]) {
+				counterMaximums[i] = current.counts[i];
+			}
+		}
+		for (int i = 0; i < GPU_PASS_COUNT; i++) {
+			current.gpu[i] = gpuLatest[i];
+		}
+		last = current;
+	}
+	frames++;
+
+	current.start = now;
+	current.frameTime = 0;
+	for (int i = 0; i < PHASE_COUNT; i++) {
+		current.phases[i] = 0;
+	}
+	for (int i = 0; i < COUNTER_COUNT; i++) {
+		current.counts[i] = 0;
+	}
+}
+
+/*
+ * Count hardware events in every phase from now on (on the calling thread,
+ * which must be the one timing phases).  Returns false (after printing why)
+ * if the counters aren't available.
+ */
+bool profilerEnablePerfCounters() {
+	perfEnabled = perfCountersOpen() == 0;
+	return perfEnabled;
+}
+
+/*
+ * Start timing a phase of the current frame
+ */
+void profilerBegin(enum ProfilerPhase phase) {
+	assert(phase < PHASE_COUNT);
+	TRACE_BEGIN(profilerPhaseNames[phase]);
+	if (perfEnabled) {
+		perfCountersRead(perfStart[phase]);
+	}
+	phaseStart[phase] = profilerNow();
+}
+
+/*
+ * Stop timing a phase of the current frame
+ */
+void profilerEnd(enum ProfilerPhase phase) {
+	assert(phase < PHASE_COUNT);
+	current.phases[phase] += (profilerNow() - phaseStart[phase]) * 1000.0;
+
+	uint64_t counts[PERF_COUNTER_COUNT];
+	if (perfEnabled && perfCountersRead(counts)) {
+		for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+			perfTotals[phase][i] += counts[i] - perfStart[phase][i];
+		}
+	}
+	TRACE_END(profilerPhaseNames[phase]);
+}
+
+/*
+ * Record the GPU times of a (recent) frame
+ */
+void profilerGpuTimes(const double ms[GPU_PASS_COUNT]) {
+	for (int i = 0; i < GPU_PASS_COUNT; i++) {
+		gpuLatest[i] = ms[i];
+		histogramAdd(&gpuHistograms[i], ms[i]);
+	}
+}
+
+/*
+ * Add n to a counter of the current frame
+ */
+void profilerCount(enum ProfilerCounter counter, unsigned long n) {
+	current.counts[counter] += n;
+}
+
+/*
+ * The last complete frame
+ */
+const ProfilerFrame *profilerLastFrame() {
+	return &last;
+}
+
+static void printHistogram(FILE *s, const char *name, ProfilerHistogram *h) {
+	fprintf(s, "  %-12s mean=%7.3f p50=%7.3f p90=%7.3f p99=%7.3f "
+	    "max=%8.3f\n", name, h->sum / h->total,
+	    histogramPercentile(h, 50), histogramPercentile(h, 90),
+	    histogramPercentile(h, 99), h->max);
+}
+
+/*
+ * How often the frame interval changed by how much - the spread that shows
+ * up on screen as a hitch
+ */
+static void printJitter(FILE *s) {
+	static const double edges[] = { 0.1, 0.5, 1, 2, 5, 10, 30 };
+	static const int numEdges = sizeof (edges) / sizeof (edges[0]);
+	ProfilerHistogram *h = &jitterHistogram;
+	unsigned int bucket = 0;
+
+	fprintf(s, "Jitter (%lu frames, change in frame interval in ms)\n",
+	    h->total);
+	printHistogram(s, "jitter", h);
+	fprintf(s, "  %-12s p99.9=%7.3f\n", "", histogramPercentile(h, 99.9));
+
+	for (int i = 0; i <= numEdges; i++) {
+		unsigned long n = 0;
+		while (bucket < PROFILER_BUCKETS && (i == numEdges ||
+		    (bucket + 1) * PROFILER_BUCKET_MS <= edges[i] + 1e-9)) {
+			n += h->counts[bucket++];
+		}
+		if (i < numEdges) {
+			fprintf(s, "  %5s<%-6g %10lu %6.2f%%\n", "", edges[i],
+			    n, 100.0 * n / h->total);
+		} else {
+			fprintf(s, "  %4s>=%-6g %10lu %6.2f%%\n", "",
+			    edges[i - 1], n, 100.0 * n / h->total);
+		}
+	}
+}
+
+/*
+ * Print the frame time, per-phase time and jitter distributions (in
+ * milliseconds)
+ */
+void profilerPrintSummary(FILE *s) {
+	if (frameHistogram.total == 0) {
+		return;
+	}
+
+	fprintf(s, "Profile (%lu frames, times in ms)\n", frameHistogram.total);
+	printHistogram(s, "frame", &frameHistogram);
+	for (int i = 0; i < PHASE_COUNT; i++) {
+		printHistogram(s, profilerPhaseNames[i], &phaseHistograms[i]);
+	}
+
+	if (jitterHistogram.total > 0) {
+		printJitter(s);
+	}
+
+	if (gpuHistograms[0].total > 0) {
+		fprintf(s, "GPU (%lu frames, times in ms)\n",
+		    gpuHistograms[0].total);
+		for (int i = 0; i < GPU_PASS_COUNT; i++) {
+			printHistogram(s, profilerGpuPassNames[i],
+			    &gpuHistograms[i]);
+		}
+	}
+
+	if (perfEnabled) {
+		double n = frameHistogram.total;
+		fprintf(s, "Hardware counters (per frame)\n");
+		fprintf(s, "  %-12s %12s %6s %12s %12s\n", "phase",
+		    "instructions", "ipc", "cacheMisses", "branchMisses");
+		for (int i = 0; i < PHASE_COUNT; i++) {
+			uint64_t *t = perfTotals[i];
+			fprintf(s, "  %-12s %12.0f %6.2f %12.0f %12.0f\n",
+			    profilerPhaseNames[i], t[PerfInstructions] / n,
+			    t[PerfCycles] > 0 ?
+			    (double)t[PerfInstructions] / t[PerfCycles] : 0,
+			    t[PerfCacheMisses] / n, t[PerfBranchMisses] / n);
+		}
+	}
+
+	fprintf(s, "Counters (per frame)\n");
+	for (int i = 0; i < COUNTER_COUNT; i++) {
+		fprintf(s, "  %-12s mean=%10.1f max=%lu\n",
+		    profilerCounterNames[i],
+		    (double)counterSums[i] / frameHistogram.total,
+		    counterMaximums[i]);
+	}
+}
@@ -0,0 +1,85 @@
+/*
+ * Per-frame phase timing
+ *
+ * The main loop is split into phases (see ProfilerPhase).  Each phase is
+ * timed every frame - the times of the last frame are available to the
+ * metrics stream and a histogram of every frame is kept for the summary
+ * printed on exit.  Phases are also recorded as trace events (see trace.h).
+ *
+ * GPU pass times (measured by gputimer.c, which arrive a few frames late)
+ * and per-frame counters of the GL work submitted are kept alongside, as
+ * are hardware counters for each phase if profilerEnablePerfCounters() was
+ * called (see perfcounters.h).
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+enum ProfilerPhase {
+	PhaseEvents,
+	PhaseClear,
+	PhaseUpdate,
+	PhaseDraw,
+	PhaseLines,
+	PhaseHud,
+	PhaseSwap,
+	PHASE_COUNT
+};
+
+enum ProfilerGpuPass {
+	GpuPassFade,
+	GpuPassParticles,
+	GpuPassLines,
+	GPU_PASS_COUNT
+};
+
+enum ProfilerCounter {
+	CounterDrawCalls,
+	CounterVertices,
+	CounterStateChanges,
+	COUNTER_COUNT
+};
+
+// Histogram resolution and range (in milliseconds)
+#define PROFILER_BUCKET_MS 0.05
+#define PROFILER_BUCKETS 2000
+
+typedef struct ProfilerFrame {
+	// wall clock seconds the frame started
+	double start;
+
+	// milliseconds since the previous frame started
+	double frameTime;
+
+	// milliseconds spent in each phase
+	double phases[PHASE_COUNT];
+
+	// milliseconds each pass took on the GPU (the latest results, which
+	// are from a few frames earlier), all 0 without GPU timing
+	double gpu[GPU_PASS_COUNT];
+
+	// GL work submitted during the frame
+	unsigned long counts[COUNTER_COUNT];
+} ProfilerFrame;
+
+extern const char *profilerPhaseNames[PHASE_COUNT];
+extern const char *profilerGpuPassNames[GPU_PASS_COUNT];
+extern const char *profilerCounterNames[COUNTER_COUNT];
+
+bool profilerEnablePerfCounters();
+void profilerFrameBegin();
+void profilerBegin(enum ProfilerPhase phase);
+void profilerEnd(enum ProfilerPhase phase);
+void profilerGpuTimes(const double ms[GPU_PASS_COUNT]);
+void profilerCount(enum ProfilerCounter counter, unsigned long n);
+const ProfilerFrame *profilerLastFrame();
+void profilerPrintSummary(FILE *s);
+
+#endif
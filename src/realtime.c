@@ -0,0 +1,226 @@
+/*
+ * Low-jitter realtime mode
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "realtime.h"
+
+static bool enabled = false;
+static int pinnedRenderCpu = -1;
+static int pinnedWorkerCpu = -1;
+
+#ifdef __linux__
+// the CPUs the process was allowed to run on before the render thread was
+// pinned
+static cpu_set_t allowed;
+#endif
+
+/*
+ * Pin the calling thread to a single CPU, or (cpu < 0) to every allowed CPU
+ * except the one given by exclude.
+ */
+static int pinThread(int cpu, int exclude) {
+#ifdef __linux__
+	cpu_set_t set;
+
+	if (cpu >= 0) {
+		if (cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed)) {
+			warnx("cpu %d is not available to this process", cpu);
+			return -1;
+		}
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+	} else {
+		set = allowed;
+		if (exclude >= 0 && exclude < CPU_SETSIZE &&
+		    CPU_COUNT(&set) > 1) {
+			CPU_CLR(exclude, &set);
+		}
+	}
+
+	int ret = pthread_setaffinity_np(pthread_self(), sizeof (set), &set);
+	if (ret != 0) {
+		warnx("pthread_setaffinity_np: %s", strerror(ret));
+		return -1;
+	}
+	return 0;
+#else
+	if (cpu >= 0) {
+		warnx("pinning threads to a cpu is only supported on Linux");
+		return -1;
+	}
+	return 0;
+#endif
+}
+
+/*
+ * Set the scheduling policy of the calling thread
+ */
+static int setScheduler(int policy, int priority) {
+	struct sched_param param;
+
+	memset(&param, 0, sizeof (param));
+	param.sched_priority = priority;
+
+	int ret = pthread_setschedparam(pthread_self(), policy, &param);
+	if (ret != 0) {
+		warnx("pthread_setschedparam: %s%s", strerror(ret),
+		    ret == EPERM ? " (raise RLIMIT_RTPRIO, e.g. with "
+		    "'ulimit -r', or grant CAP_SYS_NICE)" : "");
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Lock memory and remember the CPUs the render and worker threads go on.
+ * renderCpu and workerCpu may be -1 to not pin.  Worker threads started
+ * after this move off of the render CPU.  Returns the number of steps that
+ * failed.
+ */
+int realtimeStart(int renderCpu, int workerCpu) {
+	int failed = 0;
+
+	pinnedRenderCpu = renderCpu;
+	pinnedWorkerCpu = workerCpu;
+	enabled = true;
+
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+		warn("mlockall%s", errno == ENOMEM || errno == EPERM ?
+		    " (raise RLIMIT_MEMLOCK, e.g. with 'ulimit -l')" : "");
+		failed++;
+	}
+
+#ifdef __linux__
+	if (sched_getaffinity(0, sizeof (allowed), &allowed) != 0) {
+		warn("sched_getaffinity");
+		CPU_ZERO(&allowed);
+		pinnedRenderCpu = -1;
+		pinnedWorkerCpu = -1;
+		failed++;
+	}
+#endif
+
+	return failed;
+}
+
+/*
+ * Pin the calling (render) thread to the render CPU and raise it to
+ * SCHED_FIFO at the given priority (0 to keep the normal scheduler).  Threads
+ * inherit both, so this is called once every thread the render thread starts
+ * indirectly (SDL's audio thread, GL driver threads) already exists.  Returns
+ * the number of steps that failed.
+ */
+int realtimeRenderThread(int priority) {
+	int failed = 0;
+
+	if (!enabled) {
+		return 0;
+	}
+
+	if (pinnedRenderCpu >= 0 && pinThread(pinnedRenderCpu, -1) != 0) {
+		pinnedRenderCpu = -1;
+		failed++;
+	}
+
+	if (priority > 0) {
+		int lo = sched_get_priority_min(SCHED_FIFO);
+		int hi = sched_get_priority_max(SCHED_FIFO);
+		if (priority < lo || priority > hi) {
+			warnx("SCHED_FIFO priority must be between %d and %d",
+			    lo, hi);
+			failed++;
+		} else if (setScheduler(SCHED_FIFO, priority) != 0) {
+			failed++;
+		}
+	}
+
+	return failed;
+}
+
+bool realtimeEnabled() {
+	return enabled;
+}
+
+/*
+ * Called by every worker thread as it starts: run on the worker CPU (or any
+ * CPU but the render thread's) with the normal scheduler.  Does nothing
+ * unless realtimeStart() was called.
+ */
+void realtimeWorkerThread() {
+	if (!enabled) {
+		return;
+	}
+
+	if (pinnedWorkerCpu >= 0 || pinnedRenderCpu >= 0) {
+		pinThread(pinnedWorkerCpu, pinnedRenderCpu);
+	}
+	setScheduler(SCHED_OTHER, 0);
+}
+
+/*
+ * Touch size bytes of stack so later calls never fault a stack page in
+ * (mlockall() only locks the pages the stack already has).
+ */
+void realtimePrefaultStack(size_t size) {
+	unsigned char buf[size];
+	volatile unsigned char *page = buf;
+
+	for (size_t i = 0; i < size; i += 4096) {
+		page[i] = 0;
+	}
+}
+
+/*
+ * Monotonic time in seconds, the same clock realtimeSleepUntil() uses
+ */
+double realtimeNow() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Sleep until the given realtimeNow() time.  The deadline is absolute, so
+ * time spent before the call (or a late wakeup) never adds up over frames.
+ */
+void realtimeSleepUntil(double deadline) {
+	struct timespec ts;
+	ts.tv_sec = (time_t)deadline;
+	ts.tv_nsec = (long)((deadline - ts.tv_sec) * 1e9);
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+
+#ifdef __linux__
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts,
+	    NULL) == EINTR)
+		;
+#else
+	// no absolute sleep, sleep for what is left until it has passed
+	double now;
+	while ((now = realtimeNow()) < deadline) {
+		double left = deadline - now;
+		struct timespec rel = { (time_t)left,
+		    (long)((left - (time_t)left) * 1e9) };
+		nanosleep(&rel, NULL);
+	}
+#endif
+}
@@ -0,0 +1,41 @@
+/*
+ * Low-jitter realtime mode
+ *
+ * realtimeStart() is called from the render thread before any worker thread
+ * is started.  It locks all current and future memory (so nothing is paged
+ * out or faulted in mid-frame).  Worker threads call realtimeWorkerThread()
+ * when they start so they run on the worker CPU (or anywhere but the render
+ * CPU) under the normal scheduler.
+ *
+ * realtimeRenderThread() then optionally pins the render thread to a CPU and
+ * raises it to SCHED_FIFO.  It is called last, once the window, GL context
+ * and audio device exist: the threads SDL and the GL driver start for those
+ * are not ours to move, and this way they are started by an unpinned,
+ * normally scheduled thread and keep running anywhere (including the render
+ * CPU) under the normal scheduler instead of inheriting the render thread's
+ * placement and priority.  Only the render thread is pinned.
+ *
+ * Every step is best-effort: what the system refuses is explained (usually a
+ * missing RLIMIT_MEMLOCK / RLIMIT_RTPRIO or CAP_SYS_NICE) and the rest keeps
+ * working.
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+int realtimeStart(int renderCpu, int workerCpu);
+int realtimeRenderThread(int priority);
+bool realtimeEnabled();
+void realtimeWorkerThread();
+void realtimePrefaultStack(size_t size);
+double realtimeNow();
+void realtimeSleepUntil(double deadline);
+
+#endif
@@ -7,7 +7,9 @@
  * License: MIT
  */
 
+#include <assert.h>
 #include <math.h>
+#include <stdlib.h>
 
 #include "ryb2rgb.h"
 
@@ -27,6 +29,10 @@ static float cubicInt(float t, float A, float B) {
 	return A + weight * (B - A);
 }
 
+static float linearInt(float t, float A, float B) {
+	return A + t * (B - A);
+}
+
 RGB interpolate2rgb(float a, float b, float c, const float magic[8][3]) {
 	RGB rgb;
 	float x0, x1, x2, x3;
@@ -65,3 +71,227 @@ RGB interpolate2rgb(float a, float b, float c, const float magic[8][3]) {
 RGB ryb2rgb(float r, float y, float b) {
 	return interpolate2rgb(r, y, b, RYB_MAGIC_COLORS);
 }
+
+/*
+ * Expand the magic table into the per-channel polynomial coefficients used by
+ * rybPaletteEval().  The corner for inputs (a, b, c) in {0, 1} is
+ * magic[a * 2 + b + c * 4].
+ */
+void rybPaletteCompile(RYBPalette *palette, const float magic[8][3]) {
+	assert(palette != NULL);
+
+	for (int ch = 0; ch < 4; ch++) {
+		if (ch == 3) {
+			// padding
+			for (int i = 0; i < 8; i++) {
+				palette->k[i][ch] = 0;
+			}
+			break;
+		}
+
+		float m000 = magic[0][ch];
+		float m001 = magic[4][ch];
+		float m010 = magic[1][ch];
+		float m011 = magic[5][ch];
+		float m100 = magic[2][ch];
+		float m101 = magic[6][ch];
+		float m110 = magic[3][ch];
+		float m111 = magic[7][ch];
+		float (*k)[4] = palette->k;
+
+		k[0][ch] = m000;
+		k[1][ch] = m001 - m000;
+		k[2][ch] = m010 - m000;
+		k[3][ch] = m011 - m010 - m001 + m000;
+		k[4][ch] = m100 - m000;
+		k[5][ch] = m101 - m100 - m001 + m000;
+		k[6][ch] = m110 - m100 - m010 + m000;
+		k[7][ch] = m111 - m110 - m101 - m011 + m100 + m010 + m001 - m000;
+	}
+}
+
+/*
+ * Equivalent to interpolate2rgb() with the magic table the palette was
+ * compiled from (to within float rounding).
+ *
+ * The terms are written as plain multiply-adds rather than with fmaf(): unless
+ * hardware FMA is enabled at compile time fmaf() is a libm call, while the
+ * compiler fuses a * b + c by itself wherever the target can.  The channel
+ * loop covers the padding too so it compiles to straight vector code.
+ */
+RGB rybPaletteEval(const RYBPalette *palette, float a, float b, float c) {
+	const float (*k)[4] = palette->k;
+	float out[4];
+	RGB rgb;
+
+	a = a * a * (3 - 2 * a);
+	b = b * b * (3 - 2 * b);
+	c = c * c * (3 - 2 * c);
+
+	for (int ch = 0; ch < 4; ch++) {
+		float lo = b * (k[3][ch] * c + k[2][ch]) +
+		    (k[1][ch] * c + k[0][ch]);
+		float hi = b * (k[7][ch] * c + k[6][ch]) +
+		    (k[5][ch] * c + k[4][ch]);
+		out[ch] = a * hi + lo;
+	}
+
+	rgb.r = out[0];
+	rgb.g = out[1];
+	rgb.b = out[2];
+
+	return rgb;
+}
+
+/*
+ * Create an (unbuilt) color cube with size samples along each axis
+ *
+ * Returns NULL if size is less than 2 or the allocation fails.  Must be freed
+ * by the caller with rybCubeDestroy()
+ */
+RYBCube *rybCubeCreate(unsigned int size) {
+	if (size < 2) {
+		return NULL;
+	}
+
+	RYBCube *cube = malloc(sizeof (RYBCube));
+	if (cube == NULL) {
+		return NULL;
+	}
+
+	cube->size = size;
+	cube->data = malloc(sizeof (RGB) * size * size * size);
+	if (cube->data == NULL) {
+		free(cube);
+		return NULL;
+	}
+
+	return cube;
+}
+
+/*
+ * Sample interpolate2rgb() for the given magic table onto every grid point
+ * of the cube.  This should be called again any time the magic table changes.
+ */
+void rybCubeBuild(RYBCube *cube, const float magic[8][3]) {
+	assert(cube != NULL);
+
+	unsigned int n = cube->size;
+	float step = 1.0f / (float)(n - 1);
+	RGB *ptr = cube->data;
+
+	for (unsigned int i = 0; i < n; i++) {
+		for (unsigned int j = 0; j < n; j++) {
+			for (unsigned int k = 0; k < n; k++) {
+				*ptr++ = interpolate2rgb(i * step, j * step,
+				    k * step, magic);
+			}
+		}
+	}
+}
+
+/*
+ * Lookup a color in the cube - inputs are clamped to [0, 1]
+ */
+RGB rybCubeLookup(const RYBCube *cube, float a, float b, float c) {
+	unsigned int n = cube->size;
+	float max = (float)(n - 1);
+
+	a = (a < 0 ? 0 : a > 1 ? 1 : a) * max;
+	b = (b < 0 ? 0 : b > 1 ? 1 : b) * max;
+	c = (c < 0 ? 0 : c > 1 ? 1 : c) * max;
+
+	// the lower grid point (clamped so the upper point is always valid)
+	unsigned int i = a >= max ? n - 2 : (unsigned int)a;
+	unsigned int j = b >= max ? n - 2 : (unsigned int)b;
+	unsigned int k = c >= max ? n - 2 : (unsigned int)c;
+
+	float fa = a - i;
+	float fb = b - j;
+	float fc = c - k;
+
+	const RGB *p000 = cube->data + (i * n + j) * n + k;
+	const RGB *p001 = p000 + 1;
+	const RGB *p010 = p000 + n;
+	const RGB *p011 = p010 + 1;
+	const RGB *p100 = p000 + n * n;
+	const RGB *p101 = p100 + 1;
+	const RGB *p110 = p100 + n;
+	const RGB *p111 = p110 + 1;
+
+	RGB rgb;
+	float x0, x1, x2, x3;
+	float y0, y1;
+
+	// red
+	x0 = linearInt(fc, p000->r, p001->r);
+	x1 = linearInt(fc, p010->r, p011->r);
+	x2 = linearInt(fc, p100->r, p101->r);
+	x3 = linearInt(fc, p110->r, p111->r);
+	y0 = linearInt(fb, x0, x1);
+	y1 = linearInt(fb, x2, x3);
+	rgb.r = linearInt(fa, y0, y1);
+
+	// green
+	x0 = linearInt(fc, p000->g, p001->g);
+	x1 = linearInt(fc, p010->g, p011->g);
+	x2 = linearInt(fc, p100->g, p101->g);
+	x3 = linearInt(fc, p110->g, p111->g);
+	y0 = linearInt(fb, x0, x1);
+	y1 = linearInt(fb, x2, x3);
+	rgb.g = linearInt(fa, y0, y1);
+
+	// blue
+	x0 = linearInt(fc, p000->b, p001->b);
+	x1 = linearInt(fc, p010->b, p011->b);
+	x2 = linearInt(fc, p100->b, p101->b);
+	x3 = linearInt(fc, p110->b, p111->b);
+	y0 = linearInt(fb, x0, x1);
+	y1 = linearInt(fb, x2, x3);
+	rgb.b = linearInt(fa, y0, y1);
+
+	return rgb;
+}
+
+/*
+ * Measure the maximum absolute error (across all channels) of the cube
+ * against interpolate2rgb() by sampling steps^3 points offset from the grid.
+ */
+float rybCubeError(const RYBCube *cube, const float magic[8][3], unsigned int
+    steps) {
+
+	float maxError = 0;
+
+	for (unsigned int i = 0; i < steps; i++) {
+		float a = (i + 0.5f) / steps;
+		for (unsigned int j = 0; j < steps; j++) {
+			float b = (j + 0.5f) / steps;
+			for (unsigned int k = 0; k < steps; k++) {
+				float c = (k + 0.5f) / steps;
+
+				RGB exact = interpolate2rgb(a, b, c, magic);
+				RGB approx = rybCubeLookup(cube, a, b, c);
+
+				maxError = fmaxf(maxError,
+				    fabsf(exact.r - approx.r));
+				maxError = fmaxf(maxError,
+				    fabsf(exact.g - approx.g));
+				maxError = fmaxf(maxError,
+				    fabsf(exact.b - approx.b));
+			}
+		}
+	}
+
+	return maxError;
+}
+
+/*
+ * Free a color cube
+ */
+void rybCubeDestroy(RYBCube *cube) {
+	if (cube == NULL) {
+		return;
+	}
+	free(cube->data);
+	free(cube);
+}
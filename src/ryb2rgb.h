@@ -7,11 +7,51 @@
  * License: MIT
  */
 
+#ifndef RYB2RGB_H
+#define RYB2RGB_H
+
 typedef struct RGB {
 	float r;
 	float g;
 	float b;
 } RGB;
 
+/*
+ * A magic table "compiled" into polynomial form.  interpolate2rgb() is a
+ * trilinear blend of the 8 magic colors using the smoothstep of each input as
+ * the weight, so each channel expands to
+ *
+ *   k0 + k1*c + k2*b + k3*bc + k4*a + k5*ac + k6*ab + k7*abc
+ *
+ * with a, b and c being the smoothstep weights.  The coefficients only depend
+ * on the magic table and are calculated once by rybPaletteCompile().  They are
+ * stored term-major (k[term][channel], padded to 4 channels) so each term is
+ * evaluated for all channels at once.
+ */
+typedef struct RYBPalette {
+	float k[8][4];
+} RYBPalette;
+
+/*
+ * A 3D lookup table of interpolate2rgb() sampled on a size^3 grid for a given
+ * magic table.  Lookups are trilinear between the nearest grid points.
+ */
+typedef struct RYBCube {
+	unsigned int size;
+	RGB *data;
+} RYBCube;
+
 RGB interpolate2rgb(float a, float b, float c, const float magic[8][3]);
 RGB ryb2rgb(float r, float y, float b);
+
+void rybPaletteCompile(RYBPalette *palette, const float magic[8][3]);
+RGB rybPaletteEval(const RYBPalette *palette, float a, float b, float c);
+
+RYBCube *rybCubeCreate(unsigned int size);
+void rybCubeBuild(RYBCube *cube, const float magic[8][3]);
+RGB rybCubeLookup(const RYBCube *cube, float a, float b, float c);
+float rybCubeError(const RYBCube *cube, const float magic[8][3], unsigned int
+    steps);
+void rybCubeDestroy(RYBCube *cube);
+
+#endif
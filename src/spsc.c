@@ -0,0 +1,139 @@
+/*
+ * A lock-free single-producer / single-consumer ring buffer
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spsc.h"
+
+/*
+ * Create a ring holding up to capacity elements of elemSize bytes each.
+ * capacity is rounded up to a power of 2.
+ *
+ * Returns NULL on failure.  Must be freed by the caller with spscDestroy()
+ */
+SpscRing *spscCreate(size_t elemSize, size_t capacity) {
+	assert(elemSize > 0);
+
+	size_t cap = 1;
+	while (cap < capacity) {
+		cap *= 2;
+	}
+
+	SpscRing *ring = aligned_alloc(64, sizeof (SpscRing));
+	if (ring == NULL) {
+		return NULL;
+	}
+
+	ring->buf = malloc(elemSize * cap);
+	if (ring->buf == NULL) {
+		free(ring);
+		return NULL;
+	}
+
+	ring->capacity = cap;
+	ring->elemSize = elemSize;
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+
+	return ring;
+}
+
+/*
+ * Copy n elements (or as many as fit) from the contiguous range starting at
+ * index "start" in the ring to/from elems.
+ */
+static void spscCopy(SpscRing *ring, size_t start, void *elems, size_t n,
+    int toRing) {
+
+	size_t idx = start & (ring->capacity - 1);
+	size_t first = ring->capacity - idx;
+	if (first > n) {
+		first = n;
+	}
+
+	unsigned char *ringPtr = ring->buf + idx * ring->elemSize;
+	unsigned char *elemsPtr = elems;
+	size_t firstBytes = first * ring->elemSize;
+	size_t restBytes = (n - first) * ring->elemSize;
+
+	if (toRing) {
+		memcpy(ringPtr, elemsPtr, firstBytes);
+		memcpy(ring->buf, elemsPtr + firstBytes, restBytes);
+	} else {
+		memcpy(elemsPtr, ringPtr, firstBytes);
+		memcpy(elemsPtr + firstBytes, ring->buf, restBytes);
+	}
+}
+
+/*
+ * Push up to n elements - producer only.  Returns the number of elements
+ * pushed, which is less than n if the ring filled up.
+ */
+size_t spscPush(SpscRing *ring, const void *elems, size_t n) {
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+	size_t space = ring->capacity - (head - tail);
+
+	if (n > space) {
+		n = space;
+	}
+	if (n == 0) {
+		return 0;
+	}
+
+	spscCopy(ring, head, (void *)elems, n, 1);
+	atomic_store_explicit(&ring->head, head + n, memory_order_release);
+
+	return n;
+}
+
+/*
+ * Pop up to n elements - consumer only.  Returns the number of elements
+ * popped, which is less than n if the ring ran empty.
+ */
+size_t spscPop(SpscRing *ring, void *elems, size_t n) {
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+	size_t count = head - tail;
+
+	if (n > count) {
+		n = count;
+	}
+	if (n == 0) {
+		return 0;
+	}
+
+	spscCopy(ring, tail, elems, n, 0);
+	atomic_store_explicit(&ring->tail, tail + n, memory_order_release);
+
+	return n;
+}
+
+/*
+ * Number of elements currently in the ring (approximate when called while
+ * the other side is active).
+ */
+size_t spscCount(SpscRing *ring) {
+	size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+	return head - tail;
+}
+
+/*
+ * Free a ring
+ */
+void spscDestroy(SpscRing *ring) {
+	if (ring == NULL) {
+		return;
+	}
+	free(ring->buf);
+	free(ring);
+}
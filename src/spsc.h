@@ -0,0 +1,38 @@
+/*
+ * A lock-free single-producer / single-consumer ring buffer
+ *
+ * Exactly one thread may push and exactly one (other) thread may pop.
+ * Neither side ever blocks: a push to a full ring or a pop from an empty
+ * ring simply transfers fewer elements than asked for.
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+typedef struct SpscRing {
+	// written by the producer
+	_Alignas(64) atomic_size_t head;
+
+	// written by the consumer
+	_Alignas(64) atomic_size_t tail;
+
+	// read-only after creation
+	_Alignas(64) size_t capacity;
+	size_t elemSize;
+	unsigned char *buf;
+} SpscRing;
+
+SpscRing *spscCreate(size_t elemSize, size_t capacity);
+size_t spscPush(SpscRing *ring, const void *elems, size_t n);
+size_t spscPop(SpscRing *ring, void *elems, size_t n);
+size_t spscCount(SpscRing *ring);
+void spscDestroy(SpscRing *ring);
+
+#endif
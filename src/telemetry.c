@@ -0,0 +1,234 @@
+/*
+ * Shared-memory telemetry and control block
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#include <err.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "telemetry.h"
+
+/*
+ * Create (replacing any stale one) and map the block, readable and writable
+ * by the current user only.
+ *
+ * Returns NULL (after printing why) on failure.
+ */
+TelemetryBlock *telemetryCreate(const char *name, const char **phaseNames,
+    int phaseCount) {
+
+	shm_unlink(name);
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd == -1) {
+		warn("shm_open %s", name);
+		return NULL;
+	}
+
+	if (ftruncate(fd, sizeof (TelemetryBlock)) == -1) {
+		warn("ftruncate %s", name);
+		close(fd);
+		shm_unlink(name);
+		return NULL;
+	}
+
+	TelemetryBlock *block = mmap(NULL, sizeof (TelemetryBlock),
+	    PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (block == MAP_FAILED) {
+		warn("mmap %s", name);
+		shm_unlink(name);
+		return NULL;
+	}
+
+	// the new object is zero-filled
+	if (phaseCount > TELEMETRY_PHASES) {
+		phaseCount = TELEMETRY_PHASES;
+	}
+	block->phaseCount = phaseCount;
+	for (int i = 0; i < phaseCount; i++) {
+		snprintf(block->phaseNames[i], TELEMETRY_NAME_SIZE, "%s",
+		    phaseNames[i]);
+	}
+	for (uint32_t i = 0; i < TELEMETRY_COMMANDS; i++) {
+		atomic_init(&block->commands[i].seq, i);
+	}
+	block->pid = getpid();
+	block->size = sizeof (TelemetryBlock);
+	block->version = TELEMETRY_VERSION;
+
+	// last, so readers never see a half initialized block
+	atomic_thread_fence(memory_order_release);
+	block->magic = TELEMETRY_MAGIC;
+
+	return block;
+}
+
+/*
+ * Map an existing block (created by another process).
+ *
+ * Returns NULL (after printing why) on failure or if the block isn't the
+ * version this program understands.
+ */
+TelemetryBlock *telemetryOpen(const char *name) {
+	int fd = shm_open(name, O_RDWR, 0);
+	if (fd == -1) {
+		warn("shm_open %s", name);
+		return NULL;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof (uint32_t) * 3) {
+		warnx("%s: not a telemetry block", name);
+		close(fd);
+		return NULL;
+	}
+
+	TelemetryBlock *block = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+	    MAP_SHARED, fd, 0);
+	close(fd);
+	if (block == MAP_FAILED) {
+		warn("mmap %s", name);
+		return NULL;
+	}
+
+	if (block->magic != TELEMETRY_MAGIC ||
+	    block->version != TELEMETRY_VERSION ||
+	    block->size != sizeof (TelemetryBlock) ||
+	    st.st_size != sizeof (TelemetryBlock)) {
+		warnx("%s: unsupported telemetry block (version %u, expected "
+		    "%u)", name, block->version, TELEMETRY_VERSION);
+		munmap(block, st.st_size);
+		return NULL;
+	}
+
+	return block;
+}
+
+/*
+ * Publish new stats (only the creating process may call this)
+ */
+void telemetryPublish(TelemetryBlock *block, const TelemetryStats *stats) {
+	uint32_t seq = atomic_load_explicit(&block->statsSeq,
+	    memory_order_relaxed);
+	atomic_store_explicit(&block->statsSeq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	block->stats = *stats;
+	atomic_store_explicit(&block->statsSeq, seq + 2, memory_order_release);
+}
+
+/*
+ * Read a consistent snapshot of the stats
+ */
+void telemetryRead(TelemetryBlock *block, TelemetryStats *stats) {
+	for (;;) {
+		uint32_t seq1 = atomic_load_explicit(&block->statsSeq,
+		    memory_order_acquire);
+		if (seq1 & 1) {
+			continue;
+		}
+
+		*stats = block->stats;
+
+		atomic_thread_fence(memory_order_acquire);
+		uint32_t seq2 = atomic_load_explicit(&block->statsSeq,
+		    memory_order_relaxed);
+		if (seq1 == seq2) {
+			return;
+		}
+	}
+}
+
+/*
+ * Queue a command to set name to value.  Safe to call from any number of
+ * processes at once: each slot's sequence number says whether it is free
+ * for the writer at a given head position (seq == pos) or holds a command
+ * for the reader (seq == pos + 1).
+ *
+ * Returns -1 if the name is too long or the queue is full.
+ */
+int telemetrySend(TelemetryBlock *block, const char *name, int32_t value) {
+	if (strlen(name) >= TELEMETRY_NAME_SIZE) {
+		return -1;
+	}
+
+	uint32_t pos = atomic_load_explicit(&block->commandHead,
+	    memory_order_relaxed);
+	TelemetryCommand *command;
+	for (;;) {
+		command = &block->commands[pos % TELEMETRY_COMMANDS];
+		uint32_t seq = atomic_load_explicit(&command->seq,
+		    memory_order_acquire);
+		int32_t diff = (int32_t)(seq - pos);
+
+		if (diff == 0) {
+			// free, try to claim it
+			if (atomic_compare_exchange_weak_explicit(
+			    &block->commandHead, &pos, pos + 1,
+			    memory_order_relaxed, memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			// full
+			return -1;
+		} else {
+			// another writer claimed it first
+			pos = atomic_load_explicit(&block->commandHead,
+			    memory_order_relaxed);
+		}
+	}
+
+	snprintf(command->name, TELEMETRY_NAME_SIZE, "%s", name);
+	command->value = value;
+	atomic_store_explicit(&command->seq, pos + 1, memory_order_release);
+
+	return 0;
+}
+
+/*
+ * Take the next queued command, if any (only the creating process may call
+ * this).  name must hold TELEMETRY_NAME_SIZE bytes.
+ */
+bool telemetryPoll(TelemetryBlock *block, char *name, int32_t *value) {
+	uint32_t pos = atomic_load_explicit(&block->commandTail,
+	    memory_order_relaxed);
+	TelemetryCommand *command = &block->commands[pos % TELEMETRY_COMMANDS];
+
+	uint32_t seq = atomic_load_explicit(&command->seq,
+	    memory_order_acquire);
+	if (seq != pos + 1) {
+		return false;
+	}
+
+	memcpy(name, command->name, TELEMETRY_NAME_SIZE);
+	name[TELEMETRY_NAME_SIZE - 1] = '\0';
+	*value = command->value;
+
+	// free the slot for the writer one lap later
+	atomic_store_explicit(&command->seq, pos + TELEMETRY_COMMANDS,
+	    memory_order_release);
+	atomic_store_explicit(&block->commandTail, pos + 1,
+	    memory_order_relaxed);
+
+	return true;
+}
+
+/*
+ * Unmap the block, and remove it if this process created it
+ */
+void telemetryClose(TelemetryBlock *block, const char *name, bool owner) {
+	if (block == NULL) {
+		return;
+	}
+	munmap(block, sizeof (TelemetryBlock));
+	if (owner) {
+		shm_unlink(name);
+	}
+}
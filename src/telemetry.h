@@ -0,0 +1,103 @@
+/*
+ * Shared-memory telemetry and control block
+ *
+ * The visualizer creates a POSIX shared memory segment (shm_open) holding
+ * a TelemetryBlock.  Every frame it publishes its stats under a seqlock, so
+ * any number of other processes can map the segment and read consistent
+ * snapshots without ever blocking the render thread.  Other processes can
+ * also queue commands (set a named value) on a bounded lock-free queue that
+ * the render thread drains at the start of each frame - no locks and no
+ * syscalls on either side.
+ *
+ * The layout is versioned: bump TELEMETRY_VERSION on any change to the
+ * structs below.
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TELEMETRY_MAGIC 0x4d544355 // "UCTM"
+#define TELEMETRY_VERSION 1
+
+// Default shared memory object name
+#define TELEMETRY_DEFAULT_NAME "/undercurrents"
+
+// Fixed sizes so the layout doesn't depend on the rest of the program
+#define TELEMETRY_PHASES 8
+#define TELEMETRY_NAME_SIZE 32
+#define TELEMETRY_COMMANDS 64
+
+typedef struct TelemetryStats {
+	uint64_t frame;
+	double time;
+	double fps;
+	double frameTime;
+
+	// milliseconds per phase (see phaseNames in TelemetryBlock)
+	double phases[TELEMETRY_PHASES];
+
+	uint32_t ringCount;
+	uint32_t particleCount;
+	uint32_t recycledParticles;
+	uint32_t linesDrawn;
+	uint64_t drawCalls;
+	uint64_t vertices;
+
+	// current modes
+	int32_t colorMode;
+	uint8_t linesEnabled;
+	uint8_t fadingMode;
+	uint8_t blankMode;
+	uint8_t paused;
+
+	// commands applied and rejected (unknown name or bad value) so far
+	uint64_t commandsApplied;
+	uint64_t commandsRejected;
+} TelemetryStats;
+
+typedef struct TelemetryCommand {
+	// queue sequence number (see telemetrySend())
+	_Atomic uint32_t seq;
+
+	char name[TELEMETRY_NAME_SIZE];
+	int32_t value;
+} TelemetryCommand;
+
+typedef struct TelemetryBlock {
+	// written once at creation
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;
+	int32_t pid;
+	uint32_t phaseCount;
+	char phaseNames[TELEMETRY_PHASES][TELEMETRY_NAME_SIZE];
+
+	// stats (seqlock: odd while being written)
+	_Alignas(64) _Atomic uint32_t statsSeq;
+	TelemetryStats stats;
+
+	// command queue: any process enqueues at head, the render thread
+	// dequeues at tail
+	_Alignas(64) _Atomic uint32_t commandHead;
+	_Alignas(64) _Atomic uint32_t commandTail;
+	TelemetryCommand commands[TELEMETRY_COMMANDS];
+} TelemetryBlock;
+
+TelemetryBlock *telemetryCreate(const char *name, const char **phaseNames,
+    int phaseCount);
+TelemetryBlock *telemetryOpen(const char *name);
+void telemetryPublish(TelemetryBlock *block, const TelemetryStats *stats);
+void telemetryRead(TelemetryBlock *block, TelemetryStats *stats);
+int telemetrySend(TelemetryBlock *block, const char *name, int32_t value);
+bool telemetryPoll(TelemetryBlock *block, char *name, int32_t *value);
+void telemetryClose(TelemetryBlock *block, const char *name, bool owner);
+
+#endif
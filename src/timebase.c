@@ -0,0 +1,142 @@
+/*
+ * The clock the simulation runs on
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+
+#include "timebase.h"
+
+/*
+ * Monotonic wall clock in seconds
+ */
+double timebaseWallNow() {
+	return (double)SDL_GetPerformanceCounter() /
+	    SDL_GetPerformanceFrequency();
+}
+
+/*
+ * Initialize a timebase starting at time 0.  audio must be given for
+ * TimebaseAudio and is ignored otherwise.
+ */
+void timebaseInit(Timebase *tb, enum TimebaseSource source, Audio *audio) {
+	assert(source != TimebaseAudio || audio != NULL);
+
+	tb->source = source;
+	tb->audio = audio;
+	tb->wallStart = timebaseWallNow();
+	tb->virtualTime = 0;
+	tb->offset = 0;
+	tb->last = 0;
+	tb->lastTickMs = 0;
+}
+
+/*
+ * Start a freshly initialized timebase at the given time (in seconds) instead
+ * of 0.  The jump doesn't show up in the next timebaseTick().  This is not
+ * meant for TimebaseAudio, which has to stay on the audio clock.
+ */
+void timebaseStartAt(Timebase *tb, double seconds) {
+	assert(tb->source != TimebaseAudio);
+
+	tb->offset = seconds;
+	tb->last = seconds;
+	tb->lastTickMs = lround(seconds * 1000.0);
+}
+
+/*
+ * Current time (in seconds) of the timebase.  This never goes backwards.
+ */
+double timebaseNow(Timebase *tb) {
+	double now = 0;
+
+	switch (tb->source) {
+	case TimebaseWall:
+		now = timebaseWallNow() - tb->wallStart;
+		break;
+	case TimebaseAudio:
+		// once the music is over, keep going on the wall clock
+		if (audioFinished(tb->audio)) {
+			tb->source = TimebaseWall;
+			tb->offset = audioClock(tb->audio) -
+			    (timebaseWallNow() - tb->wallStart);
+			now = timebaseWallNow() - tb->wallStart;
+		} else {
+			now = audioClock(tb->audio);
+		}
+		break;
+	case TimebaseVirtual:
+		now = tb->virtualTime;
+		break;
+	default: assert(false);
+	}
+
+	now += tb->offset;
+	if (now < tb->last) {
+		now = tb->last;
+	}
+	tb->last = now;
+
+	return now;
+}
+
+/*
+ * Milliseconds elapsed since the previous call.  Because this is derived from
+ * the absolute time of the timebase, rounding never accumulates into drift.
+ */
+unsigned int timebaseTick(Timebase *tb) {
+	unsigned long nowMs = lround(timebaseNow(tb) * 1000.0);
+	unsigned int delta = nowMs - tb->lastTickMs;
+	tb->lastTickMs = nowMs;
+	return delta;
+}
+
+/*
+ * Move virtual time forward - has no effect on other sources.
+ */
+void timebaseAdvance(Timebase *tb, double seconds) {
+	if (tb->source == TimebaseVirtual) {
+		tb->virtualTime += seconds;
+	}
+}
+
+/*
+ * How far (in seconds) the time last handed out by timebaseTick() (what the
+ * visuals are showing) is from the audio being heard - 0 for other sources.
+ */
+double timebaseDrift(Timebase *tb) {
+	if (tb->source != TimebaseAudio) {
+		return 0;
+	}
+	return tb->lastTickMs / 1000.0 - audioClock(tb->audio);
+}
+
+/*
+ * How far (in seconds) the audio clock has drifted from the wall clock since
+ * the timebase started - 0 for other sources.  This is how far out of sync the
+ * visuals would be if they ran on the wall clock.
+ */
+double timebaseSkew(Timebase *tb) {
+	if (tb->source != TimebaseAudio) {
+		return 0;
+	}
+	return audioClock(tb->audio) - (timebaseWallNow() - tb->wallStart);
+}
+
+/*
+ * Convert a timebase source to a string
+ */
+const char *timebaseSourceToString(enum TimebaseSource source) {
+	switch (source) {
+	case TimebaseWall:    return "wall";
+	case TimebaseAudio:   return "audio";
+	case TimebaseVirtual: return "virtual";
+	default: assert(false);
+	}
+	return NULL;
+}
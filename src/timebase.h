@@ -0,0 +1,61 @@
+/*
+ * The clock the simulation runs on
+ *
+ * Everything that moves over time (particles, ring spawning, color cycling)
+ * is driven by the time of a Timebase, which can come from:
+ *
+ * - the wall clock (the default)
+ * - the audio device (how much audio has actually been played) so the visuals
+ *   stay locked to the music
+ * - virtual time that only moves when told to, for headless and offline runs
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include "audio.h"
+
+enum TimebaseSource {
+	TimebaseWall,
+	TimebaseAudio,
+	TimebaseVirtual
+};
+
+typedef struct Timebase {
+	enum TimebaseSource source;
+
+	// the audio being followed (TimebaseAudio only)
+	Audio *audio;
+
+	// wall clock seconds when the timebase was started
+	double wallStart;
+
+	// current virtual time (TimebaseVirtual only)
+	double virtualTime;
+
+	// added to the source time, set when the audio finishes and the
+	// timebase falls back to the wall clock
+	double offset;
+
+	// the last time handed out, to ensure time never goes backwards
+	double last;
+
+	// the last time (in milliseconds) handed out by timebaseTick()
+	unsigned long lastTickMs;
+} Timebase;
+
+double timebaseWallNow();
+void timebaseInit(Timebase *tb, enum TimebaseSource source, Audio *audio);
+void timebaseStartAt(Timebase *tb, double seconds);
+double timebaseNow(Timebase *tb);
+double timebaseDrift(Timebase *tb);
+unsigned int timebaseTick(Timebase *tb);
+void timebaseAdvance(Timebase *tb, double seconds);
+double timebaseSkew(Timebase *tb);
+const char *timebaseSourceToString(enum TimebaseSource source);
+
+#endif
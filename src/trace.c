@@ -0,0 +1,251 @@
+/*
+ * Chrome trace-event recorder
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#include <assert.h>
+#include <err.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "trace.h"
+
+typedef struct TraceRecord {
+	const char *name;
+	uint64_t ts;
+	char phase;
+} TraceRecord;
+
+/*
+ * A single thread's events.  Only the owning thread writes records and head,
+ * only the flushing thread touches flushed.
+ */
+typedef struct TraceBuffer {
+	atomic_size_t head;
+	size_t flushed;
+	int tid;
+	char name[32];
+	bool named;
+	struct TraceBuffer *next;
+	TraceRecord records[TRACE_BUFFER_EVENTS];
+} TraceBuffer;
+
+bool traceEnabled = false;
+volatile sig_atomic_t traceFlushRequested = 0;
+
+// All of the thread buffers (pushed onto the head without locks)
+static _Atomic(TraceBuffer *) buffers = NULL;
+static atomic_int nextTid = 1;
+
+// This thread's buffer
+static _Thread_local TraceBuffer *localBuffer = NULL;
+
+// The output file
+static FILE *traceFile = NULL;
+static bool firstRecord = true;
+static unsigned long droppedRecords = 0;
+
+static uint64_t traceNow() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void traceSignalHandler(int sig) {
+	traceFlushRequested = 1;
+}
+
+/*
+ * Get (creating on first use) the calling thread's buffer
+ */
+static TraceBuffer *traceLocalBuffer() {
+	if (localBuffer != NULL) {
+		return localBuffer;
+	}
+
+	TraceBuffer *buffer = calloc(1, sizeof (TraceBuffer));
+	if (buffer == NULL) {
+		// tracing is best effort - just stop for this thread
+		return NULL;
+	}
+	buffer->tid = atomic_fetch_add(&nextTid, 1);
+	snprintf(buffer->name, sizeof (buffer->name), "thread-%d",
+	    buffer->tid);
+
+	TraceBuffer *head = atomic_load(&buffers);
+	do {
+		buffer->next = head;
+	} while (!atomic_compare_exchange_weak(&buffers, &head, buffer));
+
+	localBuffer = buffer;
+	return buffer;
+}
+
+/*
+ * Start tracing to the given file and install a SIGUSR1 handler that
+ * requests a flush.
+ *
+ * Returns 0 on success and -1 (after printing why) on failure.
+ */
+int traceStart(const char *path) {
+	traceFile = fopen(path, "w");
+	if (traceFile == NULL) {
+		warn("fopen %s", path);
+		return -1;
+	}
+
+	fprintf(traceFile, "[\n");
+	firstRecord = true;
+	signal(SIGUSR1, traceSignalHandler);
+	traceEnabled = true;
+
+	return 0;
+}
+
+/*
+ * Name the calling thread in the trace
+ */
+void traceThreadName(const char *name) {
+	if (!traceEnabled) {
+		return;
+	}
+
+	TraceBuffer *buffer = traceLocalBuffer();
+	if (buffer == NULL) {
+		return;
+	}
+
+	snprintf(buffer->name, sizeof (buffer->name), "%s", name);
+	buffer->named = false;
+}
+
+/*
+ * Record an event ('B' for begin or 'E' for end) for the calling thread.
+ * name must be a string that outlives the trace (ie. a literal).
+ */
+void traceEvent(const char *name, char phase) {
+	TraceBuffer *buffer = traceLocalBuffer();
+	if (buffer == NULL) {
+		return;
+	}
+
+	size_t head = atomic_load_explicit(&buffer->head,
+	    memory_order_relaxed);
+	TraceRecord *record = &buffer->records[head % TRACE_BUFFER_EVENTS];
+
+	record->name = name;
+	record->ts = traceNow();
+	record->phase = phase;
+
+	atomic_store_explicit(&buffer->head, head + 1, memory_order_release);
+}
+
+static void traceWriteSeparator() {
+	if (!firstRecord) {
+		fprintf(traceFile, ",\n");
+	}
+	firstRecord = false;
+}
+
+/*
+ * Write the events of a single buffer recorded since the last flush.  The
+ * owning thread may still be recording, so anything it could have
+ * overwritten while we were copying is thrown away.
+ */
+static void traceFlushBuffer(TraceBuffer *buffer, TraceRecord *copy) {
+	size_t head = atomic_load_explicit(&buffer->head,
+	    memory_order_acquire);
+	size_t start = buffer->flushed;
+
+	if (head - start > TRACE_BUFFER_EVENTS) {
+		droppedRecords += head - start - TRACE_BUFFER_EVENTS;
+		start = head - TRACE_BUFFER_EVENTS;
+	}
+
+	for (size_t i = start; i < head; i++) {
+		copy[i - start] = buffer->records[i % TRACE_BUFFER_EVENTS];
+	}
+
+	// anything before "valid" may have been overwritten during the copy
+	atomic_thread_fence(memory_order_acquire);
+	size_t now = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+	size_t valid = now > TRACE_BUFFER_EVENTS ?
+	    now - TRACE_BUFFER_EVENTS : 0;
+	if (valid > start) {
+		droppedRecords += valid - start;
+	}
+
+	if (!buffer->named) {
+		traceWriteSeparator();
+		fprintf(traceFile, "{\"name\":\"thread_name\",\"ph\":\"M\","
+		    "\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+		    buffer->tid, buffer->name);
+		buffer->named = true;
+	}
+
+	for (size_t i = start < valid ? valid : start; i < head; i++) {
+		TraceRecord *record = &copy[i - start];
+
+		traceWriteSeparator();
+		fprintf(traceFile, "{\"name\":\"%s\",\"ph\":\"%c\","
+		    "\"ts\":%.3f,\"pid\":1,\"tid\":%d}", record->name,
+		    record->phase, record->ts / 1000.0, buffer->tid);
+	}
+
+	buffer->flushed = head;
+}
+
+/*
+ * Write everything recorded since the last flush to the trace file.  This
+ * does I/O so it should only be called at a frame boundary (or on exit).
+ */
+void traceFlush() {
+	traceFlushRequested = 0;
+
+	if (traceFile == NULL) {
+		return;
+	}
+
+	TraceRecord *copy = malloc(sizeof (TraceRecord) * TRACE_BUFFER_EVENTS);
+	if (copy == NULL) {
+		warn("traceFlush malloc");
+		return;
+	}
+
+	TraceBuffer *buffer = atomic_load(&buffers);
+	for (; buffer != NULL; buffer = buffer->next) {
+		traceFlushBuffer(buffer, copy);
+	}
+
+	free(copy);
+	fflush(traceFile);
+}
+
+/*
+ * Flush and close the trace file
+ */
+void traceStop() {
+	if (traceFile == NULL) {
+		return;
+	}
+
+	traceFlush();
+	traceEnabled = false;
+
+	fprintf(traceFile, "\n]\n");
+	fclose(traceFile);
+	traceFile = NULL;
+
+	if (droppedRecords > 0) {
+		warnx("trace: %lu events were overwritten before being "
+		    "flushed", droppedRecords);
+	}
+}
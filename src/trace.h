@@ -0,0 +1,51 @@
+/*
+ * Chrome trace-event recorder
+ *
+ * When enabled with traceStart(), every thread records begin/end events into
+ * its own fixed-size ring buffer with no locks and no allocations after its
+ * first event - the buffers always hold the most recent events of each
+ * thread.  traceFlush() writes everything recorded since the last flush to
+ * the trace file as Chrome trace-event JSON, which can be opened in Perfetto
+ * (https://ui.perfetto.dev) or chrome://tracing.
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <signal.h>
+#include <stdbool.h>
+
+// Events each thread can hold between flushes
+#define TRACE_BUFFER_EVENTS 65536
+
+// If tracing is enabled, checked before recording anything.  This is only
+// changed by traceStart() and traceStop(), which must be called while no
+// other threads are recording.
+extern bool traceEnabled;
+
+// Set when SIGUSR1 asks for a flush (see tracePending())
+extern volatile sig_atomic_t traceFlushRequested;
+
+#define TRACE_BEGIN(name) do { \
+	if (traceEnabled) { \
+		traceEvent(name, 'B'); \
+	} \
+} while (0)
+
+#define TRACE_END(name) do { \
+	if (traceEnabled) { \
+		traceEvent(name, 'E'); \
+	} \
+} while (0)
+
+int traceStart(const char *path);
+void traceThreadName(const char *name);
+void traceEvent(const char *name, char phase);
+void traceFlush();
+void traceStop();
+
+#endif
@@ -0,0 +1,134 @@
+/*
+ * ucctl - read and control a running undercurrents through its shared-memory
+ * telemetry block (see --telemetry and telemetry.h)
+ *
+ * Author: Dave Eddy <dave@daveeddy.com>
+ * Date: December 12, 2020
+ * License: MIT
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "telemetry.h"
+
+static void printUsage(FILE *s) {
+	fprintf(s, "Usage: ucctl [-n /name] stats\n");
+	fprintf(s, "       ucctl [-n /name] watch [interval_ms]\n");
+	fprintf(s, "       ucctl [-n /name] set name value [name value ...]\n");
+	fprintf(s, "\n");
+	fprintf(s, "  -n /name   shared memory object (default %s)\n",
+	    TELEMETRY_DEFAULT_NAME);
+	fprintf(s, "\n");
+	fprintf(s, "  set accepts any undercurrents configuration variable, "
+	    "currentColorMode and\n");
+	fprintf(s, "  the flags linesEnabled, fadingMode, blankMode, paused, "
+	    "hudEnabled and\n");
+	fprintf(s, "  overdrawMode (0 or 1)\n");
+}
+
+static void printStats(TelemetryBlock *block) {
+	TelemetryStats stats;
+	telemetryRead(block, &stats);
+
+	printf("pid=%d frame=%llu time=%.3f fps=%.1f frameTime=%.3f\n",
+	    block->pid, (unsigned long long)stats.frame, stats.time, stats.fps,
+	    stats.frameTime);
+	printf("phases");
+	for (uint32_t i = 0; i < block->phaseCount; i++) {
+		printf(" %s=%.3f", block->phaseNames[i], stats.phases[i]);
+	}
+	printf("\n");
+	printf("ringCount=%u particleCount=%u recycledParticles=%u "
+	    "linesDrawn=%u drawCalls=%llu vertices=%llu\n", stats.ringCount,
+	    stats.particleCount, stats.recycledParticles, stats.linesDrawn,
+	    (unsigned long long)stats.drawCalls,
+	    (unsigned long long)stats.vertices);
+	printf("currentColorMode=%d linesEnabled=%d fadingMode=%d "
+	    "blankMode=%d paused=%d commandsApplied=%llu "
+	    "commandsRejected=%llu\n", stats.colorMode, stats.linesEnabled,
+	    stats.fadingMode, stats.blankMode, stats.paused,
+	    (unsigned long long)stats.commandsApplied,
+	    (unsigned long long)stats.commandsRejected);
+}
+
+static int parseInt(const char *s, int *out) {
+	char *end;
+	errno = 0;
+	long num = strtol(s, &end, 10);
+	if (end == s || *end != '\0' || errno != 0 || num < INT32_MIN ||
+	    num > INT32_MAX) {
+		return -1;
+	}
+	*out = num;
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	const char *name = TELEMETRY_DEFAULT_NAME;
+
+	argv++;
+	if (*argv != NULL && strcmp(*argv, "-n") == 0) {
+		if (argv[1] == NULL) {
+			printUsage(stderr);
+			return 2;
+		}
+		name = argv[1];
+		argv += 2;
+	}
+
+	const char *command = *argv++;
+	if (command == NULL || strcmp(command, "-h") == 0 ||
+	    strcmp(command, "--help") == 0) {
+		printUsage(command == NULL ? stderr : stdout);
+		return command == NULL ? 2 : 0;
+	}
+
+	TelemetryBlock *block = telemetryOpen(name);
+	if (block == NULL) {
+		errx(1, "failed to open %s (is undercurrents running with "
+		    "--telemetry %s?)", name, name);
+	}
+
+	if (strcmp(command, "stats") == 0) {
+		printStats(block);
+	} else if (strcmp(command, "watch") == 0) {
+		int ms = 1000;
+		if (*argv != NULL && (parseInt(*argv, &ms) != 0 || ms <= 0)) {
+			errx(2, "invalid interval: '%s'", *argv);
+		}
+		struct timespec interval = { ms / 1000,
+		    (ms % 1000) * 1000000L };
+		for (;;) {
+			printStats(block);
+			printf("\n");
+			fflush(stdout);
+			nanosleep(&interval, NULL);
+		}
+	} else if (strcmp(command, "set") == 0) {
+		if (*argv == NULL) {
+			printUsage(stderr);
+			return 2;
+		}
+		for (; *argv != NULL; argv += 2) {
+			int value;
+			if (argv[1] == NULL || parseInt(argv[1], &value) != 0) {
+				errx(2, "invalid value for %s", *argv);
+			}
+			if (telemetrySend(block, *argv, value) != 0) {
+				errx(1, "failed to send %s=%d (name too long "
+				    "or queue full)", *argv, value);
+			}
+		}
+	} else {
+		printUsage(stderr);
+		return 2;
+	}
+
+	telemetryClose(block, name, false);
+	return 0;
+}
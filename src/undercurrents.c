@@ -45,8 +45,10 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/resource.h>
 
 #ifdef __APPLE__
 #include <SDL.h>
@@ -57,8 +59,23 @@
 #include <SDL2/SDL_opengl.h>
 #endif
 
+#include "alloc.h"
+#include "audio.h"
+#include "benchresults.h"
+#include "featuretrack.h"
+#include "gputimer.h"
+#include "hud.h"
+#include "log.h"
+#include "overdraw.h"
+#include "metrics.h"
+#include "palette.h"
 #include "particle.h"
+#include "profiler.h"
+#include "realtime.h"
 #include "ryb2rgb.h"
+#include "telemetry.h"
+#include "timebase.h"
+#include "trace.h"
 
 // Configuration
 
@@ -134,6 +151,12 @@
  */
 #define PARTICLE_BORN_TIMER_MAXIMUM 1000
 
+/*
+ * Spawn density: the percentage (100 by default) of the usual number of
+ * particles added to every ring each time a new ring is added.
+ */
+#define PARTICLE_SPAWN_FACTOR 100
+
 /*
  * How quickly the colors cycle.
  */
@@ -158,37 +181,122 @@
  *
  * TIMER_PRINT_STATUS_LINE - how often to print the status line, 0 to disable.
  * TIMER_ADD_NEW_RING - how often to add a new ring / orbit.
+ * TIMER_COLOR_FADE - how long to crossfade when the colors are randomized or
+ *   the color mode is changed, 0 to switch instantly.
  *
  */
 #define TIMER_PRINT_STATUS_LINE 2000
 #define TIMER_ADD_NEW_RING 1000
+#define TIMER_COLOR_FADE 1000
 
 /*
- * Color modes
+ * How strongly the music (see --audio) drives the visuals, as a percentage (0
+ * to disable).  Bass louder than its recent average speeds up the particles,
+ * the overall level speeds up the color cycling, and every detected onset
+ * spawns a new ring immediately.
  */
-enum ColorMode {
-	ColorModeSolid,
-	ColorModeRinged,
-	ColorModeCircular,
-	ColorModeIndividual
-};
+#define AUDIO_REACTIVITY 100
+
+/*
+ * Video frames per second of the feature tracks written with --analyze, and
+ * the millisecond into a --featureTrack to start the visuals at.
+ */
+#define FEATURE_TRACK_FPS 60
+#define FEATURE_TRACK_START 0
+
+/*
+ * Number of samples along each axis of a color cube to approximate
+ * interpolate2rgb() with (see ryb2rgb.h) instead of the compiled palette.
+ * The cube is rebuilt every time the colors are randomized, and its error and
+ * build time are printed at startup.  Below 2 (the default 0) the compiled
+ * palette is used.  The cube is slower than the palette; it is here to
+ * measure what a lookup table would cost and lose.
+ */
+#define COLOR_CUBE_SIZE 0
+
+/*
+ * Debug check: milliseconds (of the simulation clock) after which the
+ * particle and ring pools should be warm - any allocation after that aborts
+ * the program.  Set to 0 to disable the check.
+ */
+#define ALLOCATION_WARMUP 0
+
+/*
+ * Realtime mode (--realtime) only: the CPU to pin the render thread to and
+ * the one to pin worker threads to (-1 to not pin), the SCHED_FIFO priority
+ * of the render thread (0 to keep the normal scheduler) and the frame rate
+ * frames are paced to.
+ */
+#define REALTIME_RENDER_CPU -1
+#define REALTIME_WORKER_CPU -1
+#define REALTIME_PRIORITY 0
+#define REALTIME_FRAME_RATE 60
 
 /*
- * A linked-list for particles
+ * Milliseconds to block waiting for input while nothing on screen changes
+ * (paused, blank mode or a hidden window) before running a frame anyway.
+ */
+#define IDLE_TIMEOUT 100
+
+/*
+ * Frame rate cap while the window doesn't have keyboard focus, 0 for no cap.
+ */
+#define UNFOCUSED_FRAME_RATE 0
+
+/*
+ * A linked-list for particles.  fadeFrom is the color the particle was drawn
+ * with when the last color mode crossfade started (only set if fading is, see
+ * startColorModeFade()).
  */
 typedef struct ParticleNode {
 	Particle *particle;
 	struct ParticleNode *next;
+	RGB fadeFrom;
+	bool fading;
 } ParticleNode;
 
+/*
+ * What a ring cost during the last frame, collected by the update and line
+ * passes (and dumped with 'd')
+ */
+typedef struct RingStats {
+	unsigned int born;
+	unsigned int pairsTested;
+	unsigned int linesDrawn;
+	float minHeight;
+	float maxHeight;
+
+	// SDL performance counter ticks spent in each pass
+	Uint64 updateTicks;
+	Uint64 lineTicks;
+} RingStats;
+
 /*
  * A linked-list of particle nodes
  */
 typedef struct RingNode {
 	struct ParticleNode *particleNode;
 	struct RingNode *next;
+	unsigned int particleCount;
+	RingStats stats;
+
+	// this frame's color of every particle (see fillFrameColors())
+	RGB *colors;
 } RingNode;
 
+/*
+ * A color mode.  The fill function is given a ring (and its number, 0 being
+ * the innermost ring) and must write the color for every particle in the ring
+ * (in list order) to the given array.  The array is guaranteed to have room
+ * for ring->particleCount colors.
+ */
+typedef void (*ColorModeFill)(RingNode *ring, int i, RGB *out);
+
+typedef struct ColorMode {
+	char *name;
+	ColorModeFill fill;
+} ColorMode;
+
 // Linked list of existing rings
 RingNode *rings = NULL;
 
@@ -204,6 +312,10 @@ unsigned int recycledParticles = 0;
 // The free particle list
 ParticleNode *freeParticleNodes = NULL;
 
+// The free ring list (and how many rings are on it)
+RingNode *freeRings = NULL;
+unsigned int recycledRings = 0;
+
 // If fading mode is enabled or disabled
 bool fadingMode = true;
 
@@ -219,11 +331,118 @@ bool running = false;
 // If the animation is paused
 bool paused = false;
 
+// If the window is hidden (minimized) and if it has keyboard focus
+bool windowHidden = false;
+bool windowFocused = true;
+
+// If the performance HUD is shown
+bool hudEnabled = false;
+Hud *hud = NULL;
+
+// If hardware counters are recorded for each phase (--perfCounters)
+bool perfCountersEnabled = false;
+
+// If the overdraw heatmap is shown instead of the scene
+bool overdrawMode = false;
+Overdraw *overdraw = NULL;
+
+// If memory is locked, threads pinned and frames paced (--realtime)
+bool realtimeMode = false;
+
+// Number of frames to simulate in benchmark mode, 0 to run normally
+int benchmarkFrames = 0;
+
+// File to append the benchmark result to (--benchmarkResults)
+char *benchmarkResultsFile = NULL;
+
+// Simulated seconds to run in soak mode, 0 to run normally
+int soakSeconds = 0;
+
+// Frames to measure at every point of the scaling sweep, 0 to run normally
+int sweepFrames = 0;
+
+// Frames to check against the reference implementations, 0 to run normally
+int verifyFrames = 0;
+
+// WAV file to play (--audio) and its playback state
+char *audioFile = NULL;
+Audio *audio = NULL;
+
+// Chrome trace-event file to write (--trace)
+char *traceFile = NULL;
+
+// Shared memory telemetry/control block (--telemetry)
+char *telemetryName = NULL;
+TelemetryBlock *telemetry = NULL;
+uint64_t telemetryCommandsApplied = 0;
+uint64_t telemetryCommandsRejected = 0;
+
+// Per-frame metrics file to write (--metrics)
+char *metricsFile = NULL;
+Metrics *metrics = NULL;
+
+// Work done during the current frame (reset every frame)
+typedef struct FrameStats {
+	unsigned int born;
+	unsigned int pairsTested;
+	unsigned int linesDrawn;
+} FrameStats;
+FrameStats frameStats;
+
+// GPU pass timing, NULL if the driver can't do it
+GpuTimer *gpuTimer = NULL;
+
+// The window being drawn to, NULL in the headless modes
+SDL_Window *window = NULL;
+
+// Feature track to write (--analyze) or to drive the visuals (--featureTrack)
+char *analyzeFile = NULL;
+char *featureTrackFile = NULL;
+FeatureTrack *featureTrack = NULL;
+
+// The clock driving the simulation
+Timebase timebase;
+
+// Audio driven multipliers for the particle speed and color speed
+float audioSpeedScale = 1.0;
+float audioColorScale = 1.0;
+
+// Running average of the bass energy and the last hop that was applied
+float audioBassAverage = 0;
+unsigned long lastAudioHop = 0;
+
 // Magic colors (for use with ryb2rgb) randomized
 float randomMagic[8][3];
 
-// Current color mode
-int currentColorMode = ColorModeSolid;
+// Current color mode (index into colorModes)
+int currentColorMode = 0;
+
+// Length and time left (in milliseconds) of the color mode crossfade
+unsigned int colorModeFadeDuration = 0;
+unsigned int colorModeFadeRemaining = 0;
+
+// The color table being drawn with (crossfaded when colors are randomized)
+PaletteFade palette;
+
+// The current rainbow index (cycles over time, see particleColorSpeed)
+float rainbowIdx = 0;
+
+// Time left (in milliseconds) until the next ring is added
+int addNewRingCounter = 0;
+
+// Scratch space for the colors of a single ring (see ColorMode)
+RGB *ringColors = NULL;
+unsigned int ringColorsSize = 0;
+
+// The colors of every ring for the frame being drawn (see fillFrameColors())
+RGB *frameColors = NULL;
+unsigned int frameColorsSize = 0;
+
+// randomMagic compiled into polynomial form (see ryb2rgb.h)
+RYBPalette randomPalette;
+
+// Color cube approximating interpolate2rgb() for randomMagic, if enabled
+RYBCube *colorCube = NULL;
 
 /*
  * All of the #defines above made available as global variables that can be
@@ -243,104 +462,99 @@ int particleLineDistanceFactor = PARTICLE_LINE_DISTANCE_FACTOR;
 int particleLineRingDisable = PARTICLE_LINE_RING_DISABLE;
 int particleExpandRate = PARTICLE_EXPAND_RATE;
 int particleBornTimerMaximum = PARTICLE_BORN_TIMER_MAXIMUM;
+int particleSpawnFactor = PARTICLE_SPAWN_FACTOR;
 int particleColorSpeed = PARTICLE_COLOR_SPEED;
 int ringsMaximum = RINGS_MAXIMUM;
 int alphaBackground = ALPHA_BACKGROUND;
 int alphaElements = ALPHA_ELEMENTS;
 int timerPrintStatusLine = TIMER_PRINT_STATUS_LINE;
 int timerAddNewRing = TIMER_ADD_NEW_RING;
+int timerColorFade = TIMER_COLOR_FADE;
+int audioReactivity = AUDIO_REACTIVITY;
+int featureTrackFps = FEATURE_TRACK_FPS;
+int featureTrackStart = FEATURE_TRACK_START;
+int colorCubeSize = COLOR_CUBE_SIZE;
+int allocationWarmup = ALLOCATION_WARMUP;
+int realtimeRenderCpu = REALTIME_RENDER_CPU;
+int realtimeWorkerCpu = REALTIME_WORKER_CPU;
+int realtimePriority = REALTIME_PRIORITY;
+int realtimeFrameRate = REALTIME_FRAME_RATE;
+int idleTimeout = IDLE_TIMEOUT;
+int unfocusedFrameRate = UNFOCUSED_FRAME_RATE;
 
 /*
  * All of the above configuration options.  Adding an option here will make it
  * show up automatically in `-h` and also be accepted as a '--' long option.
+ *
+ * Values below the minimum are rejected, whether they come from the command
+ * line or from another process at runtime (see setNamedValue()).  Anything
+ * used as a divisor, modulus or period must have a minimum of at least 1.
  */
 struct ConfigurationParameter {
 	char *name;
 	int *value;
+	int minimum;
 };
 
 struct ConfigurationParameter config[] = {
-	{ "windowWidth", &windowWidth },
-	{ "windowHeight", &windowHeight },
-	{ "particleSpeedMaximum", &particleSpeedMaximum },
-	{ "particleSpeedFactor", &particleSpeedFactor },
-	{ "particleRadiusMinimum", &particleRadiusMinimum },
-	{ "particleRadiusMaximum", &particleRadiusMaximum },
-	{ "particleHeightMinimum", &particleHeightMinimum },
-	{ "particleHeightMaximum", &particleHeightMaximum },
-	{ "particleLineDistanceMinimum", &particleLineDistanceMinimum },
-	{ "particleLineDistanceMaximum", &particleLineDistanceMaximum },
-	{ "particleLineRingDisable", &particleLineRingDisable },
-	{ "particleExpandRate", &particleExpandRate },
-	{ "particleBornTimerMaximum", &particleBornTimerMaximum },
-	{ "particleColorSpeed", &particleColorSpeed },
-	{ "ringsMaximum", &ringsMaximum },
-	{ "alphaBackground", &alphaBackground },
-	{ "alphaElements", &alphaElements },
-	{ "timerPrintStatusLine", &timerPrintStatusLine },
-	{ "timerAddNewRing", &timerAddNewRing },
-	{ NULL, NULL }
+	{ "windowWidth", &windowWidth, 1 },
+	{ "windowHeight", &windowHeight, 1 },
+	{ "particleSpeedMaximum", &particleSpeedMaximum, 1 },
+	{ "particleSpeedFactor", &particleSpeedFactor, 0 },
+	{ "particleRadiusMinimum", &particleRadiusMinimum, 0 },
+	{ "particleRadiusMaximum", &particleRadiusMaximum, 0 },
+	{ "particleHeightMinimum", &particleHeightMinimum, 0 },
+	{ "particleHeightMaximum", &particleHeightMaximum, 0 },
+	{ "particleLineDistanceMinimum", &particleLineDistanceMinimum, 0 },
+	{ "particleLineDistanceMaximum", &particleLineDistanceMaximum, 0 },
+	{ "particleLineRingDisable", &particleLineRingDisable, -1 },
+	{ "particleExpandRate", &particleExpandRate, 0 },
+	{ "particleBornTimerMaximum", &particleBornTimerMaximum, 1 },
+	{ "particleSpawnFactor", &particleSpawnFactor, 0 },
+	{ "particleColorSpeed", &particleColorSpeed, 0 },
+	{ "ringsMaximum", &ringsMaximum, 1 },
+	{ "alphaBackground", &alphaBackground, 0 },
+	{ "alphaElements", &alphaElements, 0 },
+	{ "timerPrintStatusLine", &timerPrintStatusLine, 0 },
+	{ "timerAddNewRing", &timerAddNewRing, 1 },
+	{ "timerColorFade", &timerColorFade, 0 },
+	{ "audioReactivity", &audioReactivity, 0 },
+	{ "featureTrackFps", &featureTrackFps, 1 },
+	{ "featureTrackStart", &featureTrackStart, 0 },
+	{ "colorCubeSize", &colorCubeSize, 0 },
+	{ "allocationWarmup", &allocationWarmup, 0 },
+	{ "realtimeRenderCpu", &realtimeRenderCpu, -1 },
+	{ "realtimeWorkerCpu", &realtimeWorkerCpu, -1 },
+	{ "realtimePriority", &realtimePriority, 0 },
+	{ "realtimeFrameRate", &realtimeFrameRate, 1 },
+	{ "idleTimeout", &idleTimeout, 0 },
+	{ "unfocusedFrameRate", &unfocusedFrameRate, 0 },
+	{ NULL, NULL, 0 }
 };
 
 /*
- * Convert a color mode enum to a string
- */
-char *colorModeToString(enum ColorMode mode) {
-	char *s = NULL;
-	switch (mode) {
-	case ColorModeSolid:      return "ColorModeSolid";
-	case ColorModeRinged:     return "ColorModeRinged";
-	case ColorModeCircular:   return "ColorModeCircular";
-	case ColorModeIndividual: return "ColorModeIndividual";
-	default: assert(false);
-	}
-	return s;
-}
-
-/*
- * Generate an RGB color from a given index.
- *
- * adapted from
- * https://community.khronos.org/t/a/76562/14
+ * Wrapper for malloc that records the allocation against the given subsystem
+ * (see alloc.h), takes an error message as the third argument and exits on
+ * failure.
  */
-#define MAX_COLORS (256 * 6)
-RGB rainbow(unsigned int idx) {
-	assert(idx >= 0);
-	assert(idx < MAX_COLORS);
-
-	RGB rgb;
-	float a, b, c;
-
-        unsigned int which = idx / 256;
-        float t = (float)(idx % 256) / 256.0;
-
-        switch (which) {
-        case 0: a =  1; b = t,  c =   0; break; // r->y
-        case 1: a =1-t; b = 1,  c =   0; break; // y->g
-        case 2: a =  0; b = 1,  c =   t; break; // g->c
-        case 3: a =  0; b =1-t, c =   1; break; // c->b
-        case 4: a =  t; b = 0,  c =   1; break; // b->m
-        case 5: a =  1; b = 0,  c = 1-t; break; // m->r
-	default: assert(false);
+void *safeMalloc(size_t size, enum AllocSubsystem sub, const char *msg) {
+	allocRecord(sub, size);
+	void *ptr = malloc(size);
+	if (ptr == NULL) {
+		err(2, "malloc %s", msg);
 	}
-
-	rgb.r = a;
-	rgb.g = b;
-	rgb.b = c;
-
-	return rgb;
+	return ptr;
 }
 
 /*
- * Wrapper for malloc that takes an error message as the second argument and
- * exits on failure.
+ * A random number from minimum up to (but not including) maximum, or minimum
+ * if that range is empty - both ends can be changed on their own at runtime.
  */
-void *safeMalloc(size_t size, const char *msg) {
-	void *ptr = malloc(size);
-	if (ptr == NULL) {
-		err(2, "malloc %s", msg);
+int randomBetween(int minimum, int maximum) {
+	if (maximum <= minimum) {
+		return minimum;
 	}
-	return ptr;
+	return minimum + (rand() % (maximum - minimum));
 }
 
 /*
@@ -348,12 +562,12 @@ void *safeMalloc(size_t size, const char *msg) {
  */
 void randomizeParticle(Particle *p) {
 	int speed = rand() % particleSpeedMaximum;
-	unsigned int radius = particleRadiusMinimum +
-	    (rand() % (particleRadiusMaximum - particleRadiusMinimum));
-	unsigned int height = particleHeightMinimum +
-	    (rand() % (particleHeightMaximum - particleHeightMinimum));
-	unsigned int lineDistance = particleLineDistanceMinimum +
-	    (rand() % (particleLineDistanceMaximum - particleLineDistanceMinimum));
+	unsigned int radius = randomBetween(particleRadiusMinimum,
+	    particleRadiusMaximum);
+	unsigned int height = randomBetween(particleHeightMinimum,
+	    particleHeightMaximum);
+	unsigned int lineDistance = randomBetween(particleLineDistanceMinimum,
+	    particleLineDistanceMaximum);
 	unsigned int color = rand() % MAX_COLORS;
 	int bornTimer = rand() % particleBornTimerMaximum;
 	float position = rand() % 360;
@@ -374,6 +588,7 @@ void randomizeParticle(Particle *p) {
  * particle fails to be created.
  */
 Particle *createParticle() {
+	allocRecord(AllocParticles, sizeof (Particle));
 	Particle *p = particleCreate();
 	if (p == NULL) {
 		err(2, "createParticle");
@@ -396,6 +611,7 @@ ParticleNode *makeOrReclaimRandomizedParticleNode() {
 
 		// allocate a new particle and particleNode
 		particleNode = safeMalloc(sizeof (ParticleNode),
+		    AllocParticleNodes,
 		    "makeOrReclaimParticleNode malloc ParticleNode");
 		p = createParticle();
 
@@ -408,6 +624,7 @@ ParticleNode *makeOrReclaimRandomizedParticleNode() {
 	}
 
 	particleNode->next = NULL;
+	particleNode->fading = false;
 
 	p = particleNode->particle;
 	randomizeParticle(p);
@@ -416,21 +633,60 @@ ParticleNode *makeOrReclaimRandomizedParticleNode() {
 }
 
 /*
- * Adds a new ring to the global rings linked list head.
+ * Adds a new ring to the global rings linked list head, reclaiming one from
+ * the free list if possible.
  */
 void addRing() {
-	RingNode *ringNode = safeMalloc(sizeof (RingNode),
-	    "addRing malloc RingNode");
+	RingNode *ringNode;
+
+	if (freeRings == NULL) {
+		ringNode = safeMalloc(sizeof (RingNode), AllocRings,
+		    "addRing malloc RingNode");
+	} else {
+		// reclaim an existing ring
+		ringNode = freeRings;
+		freeRings = freeRings->next;
+		recycledRings--;
+	}
 
 	ringNode->particleNode = NULL;
 	ringNode->next = rings;
+	ringNode->particleCount = 0;
+	ringNode->colors = NULL;
+	memset(&ringNode->stats, 0, sizeof (ringNode->stats));
 
 	rings = ringNode;
 	ringCount++;
 }
 
 /*
- * Remove the last ring from the rings linked list tail.
+ * Put a ring (already unlinked from the rings list) and its particles on the
+ * free lists.
+ */
+void recycleRing(RingNode *ring) {
+	// loop particles in ring and append them to the freed list
+	ParticleNode *cur = ring->particleNode;
+	while (cur != NULL) {
+		ParticleNode *next = cur->next;
+
+		cur->next = freeParticleNodes;
+		freeParticleNodes = cur;
+		recycledParticles++;
+
+		cur = next;
+	}
+
+	// append the ring to the freed list
+	ring->particleNode = NULL;
+	ring->particleCount = 0;
+	ring->next = freeRings;
+	freeRings = ring;
+	recycledRings++;
+}
+
+/*
+ * Remove the last ring from the rings linked list tail, putting it and its
+ * particles on the free lists.
  */
 void recycleLastRing() {
 	RingNode *ringPtr = rings;
@@ -443,7 +699,7 @@ void recycleLastRing() {
 	}
 
 	if (ringPtr == NULL) {
-		printf("nothing to recycle\n");
+		logPrintf(stdout, "nothing to recycle\n");
 		return;
 	}
 
@@ -457,20 +713,59 @@ void recycleLastRing() {
 	// truncate the list
 	ringPtr->next = NULL;
 
-	// loop particles in ring and append them to the freed list
-	ParticleNode *cur = last->particleNode;
-	while (cur != NULL) {
-		ParticleNode *next = cur->next;
+	recycleRing(last);
+}
 
-		cur->next = freeParticleNodes;
-		freeParticleNodes = cur;
-		recycledParticles++;
+/*
+ * Recycle every ring, returning how many there were.
+ */
+int clearRings() {
+	int cleared = 0;
+
+	while (rings != NULL) {
+		RingNode *next = rings->next;
+		recycleRing(rings);
+		rings = next;
+		cleared++;
+	}
+	ringCount = 0;
 
-		cur = next;
+	return cleared;
+}
+
+/*
+ * Fill the ring and particle free lists with as much as the scene can hold at
+ * once, so realtime mode never grows a pool (and faults in new memory)
+ * mid-frame.  Every step of updateScene() gives the ring at position i
+ * (i / 4) + 4 particles, so the ring at position i holds the sum of that over
+ * every position it has passed through.
+ */
+void prefaultScene() {
+	unsigned int particles = 0;
+	for (int i = 0; i < ringsMaximum; i++) {
+		for (int j = 0; j <= i; j++) {
+			particles += (j / 4) + 4;
+		}
+	}
+
+	// one ring more than the maximum exists before the last is recycled
+	while (ringCount + recycledRings < (unsigned int)ringsMaximum + 1) {
+		RingNode *ringNode = safeMalloc(sizeof (RingNode), AllocRings,
+		    "prefaultScene malloc RingNode");
+		memset(ringNode, 0, sizeof (RingNode));
+		ringNode->next = freeRings;
+		freeRings = ringNode;
+		recycledRings++;
 	}
 
-	// free the ring
-	free(last);
+	while (particleCount < particles) {
+		ParticleNode *particleNode = safeMalloc(sizeof (ParticleNode),
+		    AllocParticleNodes, "prefaultScene malloc ParticleNode");
+		particleNode->particle = createParticle();
+		particleNode->next = freeParticleNodes;
+		freeParticleNodes = particleNode;
+		recycledParticles++;
+	}
 }
 
 /*
@@ -498,6 +793,9 @@ void DrawCircle(float cx, float cy, float r) {
 		y = s * t + c * y;
 	}
 	glEnd();
+
+	profilerCount(CounterDrawCalls, 1);
+	profilerCount(CounterVertices, num_segments);
 }
 
 /*
@@ -523,6 +821,10 @@ void DrawLinesConnectingParticles(Particle *p1, Particle *p2) {
 	glVertex2f(x1, y1);
 	glVertex2f(x2, y2);
 	glEnd();
+
+	frameStats.linesDrawn++;
+	profilerCount(CounterDrawCalls, 1);
+	profilerCount(CounterVertices, 2);
 }
 
 /*
@@ -537,15 +839,251 @@ void randomizeMagic(float magic[8][3]) {
 }
 
 /*
- * Set the glColor to the given rainbow index
+ * Rebuild the color cube for randomMagic, first (re)creating it if
+ * colorCubeSize changed.  Returns the build time in milliseconds, or -1 if
+ * the cube is disabled (a size below 2).
  */
-void setColor(unsigned int idx, const float magic[8][3], int alpha) {
-	idx = idx % MAX_COLORS;
-	RGB rgb = rainbow(idx);
-	rgb = interpolate2rgb(rgb.r, rgb.g, rgb.b, magic);
-	float alphaF = fadingMode ? ((float)alpha / 100.0) : 1.00;;
+double buildColorCube() {
+	if (colorCube != NULL &&
+	    colorCube->size != (unsigned int)colorCubeSize) {
+		allocRecordFree(AllocColors, sizeof (RGB) * colorCube->size *
+		    colorCube->size * colorCube->size);
+		rybCubeDestroy(colorCube);
+		colorCube = NULL;
+	}
+	if (colorCubeSize < 2) {
+		return -1;
+	}
 
-	glColor4f(rgb.r, rgb.g, rgb.b, alphaF);
+	if (colorCube == NULL) {
+		allocRecord(AllocColors, sizeof (RGB) * colorCubeSize *
+		    colorCubeSize * colorCubeSize);
+		colorCube = rybCubeCreate(colorCubeSize);
+		if (colorCube == NULL) {
+			err(2, "rybCubeCreate %d", colorCubeSize);
+		}
+	}
+
+	double start = timebaseWallNow();
+	rybCubeBuild(colorCube, randomMagic);
+	return (timebaseWallNow() - start) * 1000;
+}
+
+/*
+ * Randomize the global magic colors and recompile the palette (or rebuild
+ * the color cube, if enabled) to match.  The colors on screen will crossfade
+ * to the new palette over duration milliseconds.
+ */
+void randomizeColors(unsigned int duration) {
+	static Palette next;
+
+	randomizeMagic(randomMagic);
+	rybPaletteCompile(&randomPalette, randomMagic);
+
+	if (buildColorCube() >= 0) {
+		paletteFillFromCube(&next, colorCube);
+	} else {
+		paletteFill(&next, &randomPalette);
+	}
+
+	paletteFadeStart(&palette, &next, duration);
+}
+
+/*
+ * Print the color cube's error against interpolate2rgb() and how long it
+ * takes to rebuild, if it is enabled
+ */
+void printColorCube() {
+	double ms = buildColorCube();
+	if (ms < 0) {
+		return;
+	}
+	float error = rybCubeError(colorCube, randomMagic, 64);
+	printf("colorCubeSize=%d maxError=%f (%.2f 8-bit steps) "
+	    "build=%.3fms\n", colorCubeSize, error, error * 255, ms);
+}
+
+/*
+ * Set the glColor to the given RGB color
+ */
+void setColorRGB(RGB rgb, int alpha) {
+	float alphaF = fadingMode ? ((float)alpha / 100.0) : 1.00;
+
+	if (overdrawMode) {
+		glColor4f(OVERDRAW_UNIT, OVERDRAW_UNIT, OVERDRAW_UNIT, 1.0f);
+	} else {
+		glColor4f(rgb.r, rgb.g, rgb.b, alphaF);
+	}
+	profilerCount(CounterStateChanges, 1);
+}
+
+/*
+ * Color mode fill functions (see ColorMode)
+ */
+void colorModeSolidFill(RingNode *ring, int i, RGB *out) {
+	RGB rgb = palette.current.colors[(unsigned int)rainbowIdx % MAX_COLORS];
+
+	for (unsigned int j = 0; j < ring->particleCount; j++) {
+		out[j] = rgb;
+	}
+}
+
+void colorModeRingedFill(RingNode *ring, int i, RGB *out) {
+	unsigned int idx = rainbowIdx + (i * MAX_COLORS / ringsMaximum);
+	RGB rgb = palette.current.colors[idx % MAX_COLORS];
+
+	for (unsigned int j = 0; j < ring->particleCount; j++) {
+		out[j] = rgb;
+	}
+}
+
+void colorModeCircularFill(RingNode *ring, int i, RGB *out) {
+	ParticleNode *particlePtr = ring->particleNode;
+	unsigned int offset = rainbowIdx;
+
+	for (; particlePtr != NULL; particlePtr = particlePtr->next) {
+		Particle *p = particlePtr->particle;
+		unsigned int idx = (unsigned int)(p->position / 360.0 *
+		    (float)MAX_COLORS);
+		*out++ = palette.current.colors[(idx + offset) % MAX_COLORS];
+	}
+}
+
+void colorModeIndividualFill(RingNode *ring, int i, RGB *out) {
+	ParticleNode *particlePtr = ring->particleNode;
+
+	for (; particlePtr != NULL; particlePtr = particlePtr->next) {
+		Particle *p = particlePtr->particle;
+		unsigned int idx = p->color + rainbowIdx;
+		*out++ = palette.current.colors[idx % MAX_COLORS];
+	}
+}
+
+/*
+ * All of the color modes - 'm' cycles through these in order.  Adding a mode
+ * here is all that is needed to make it available.
+ */
+ColorMode colorModes[] = {
+	{ "ColorModeSolid", colorModeSolidFill },
+	{ "ColorModeRinged", colorModeRingedFill },
+	{ "ColorModeCircular", colorModeCircularFill },
+	{ "ColorModeIndividual", colorModeIndividualFill },
+};
+#define NUM_COLOR_MODES (int)(sizeof (colorModes) / sizeof (colorModes[0]))
+
+/*
+ * Write the colors for every particle in a ring to out using the current
+ * color mode (blended from the colors saved with each particle if a color
+ * mode crossfade is in progress).  out must have room for
+ * ring->particleCount colors.
+ */
+void fillRingColorsTo(RingNode *ring, int i, RGB *out) {
+	colorModes[currentColorMode].fill(ring, i, out);
+
+	if (colorModeFadeRemaining == 0) {
+		return;
+	}
+
+	// blend from the colors on screen when the fade started (particles
+	// added since then have no saved color and start in the new mode)
+	float t = 1.0 - (float)colorModeFadeRemaining /
+	    (float)colorModeFadeDuration;
+	RGB *to = out;
+	ParticleNode *particlePtr = ring->particleNode;
+	for (; particlePtr != NULL; particlePtr = particlePtr->next, to++) {
+		if (!particlePtr->fading) {
+			continue;
+		}
+		RGB *from = &particlePtr->fadeFrom;
+
+		to->r = from->r + t * (to->r - from->r);
+		to->g = from->g + t * (to->g - from->g);
+		to->b = from->b + t * (to->b - from->b);
+	}
+}
+
+/*
+ * Fill the colors for every particle in a ring (see fillRingColorsTo()).
+ * The returned array is only valid until the next call.
+ */
+RGB *fillRingColors(RingNode *ring, int i) {
+	// ensure the scratch space is large enough
+	if (ring->particleCount > ringColorsSize) {
+		size_t oldSize = sizeof (RGB) * ringColorsSize;
+		ringColorsSize = ring->particleCount * 2;
+		allocRecordResize(AllocColors, oldSize,
+		    sizeof (RGB) * ringColorsSize);
+		ringColors = realloc(ringColors,
+		    sizeof (RGB) * ringColorsSize);
+		if (ringColors == NULL) {
+			err(2, "fillRingColors realloc");
+		}
+	}
+
+	fillRingColorsTo(ring, i, ringColors);
+
+	return ringColors;
+}
+
+/*
+ * Fill the colors of every ring once for the frame being drawn, pointing
+ * each ring's colors at its part of frameColors.  The particle and the line
+ * pass both draw from these.
+ */
+void fillFrameColors() {
+	unsigned int count = 0;
+	for (RingNode *ringPtr = rings; ringPtr != NULL;
+	    ringPtr = ringPtr->next) {
+		count += ringPtr->particleCount;
+	}
+
+	// ensure the frame's space is large enough
+	if (count > frameColorsSize) {
+		size_t oldSize = sizeof (RGB) * frameColorsSize;
+		frameColorsSize = count * 2;
+		allocRecordResize(AllocColors, oldSize,
+		    sizeof (RGB) * frameColorsSize);
+		frameColors = realloc(frameColors,
+		    sizeof (RGB) * frameColorsSize);
+		if (frameColors == NULL) {
+			err(2, "fillFrameColors realloc");
+		}
+	}
+
+	RGB *colors = frameColors;
+	RingNode *ringPtr = rings;
+	for (int i = 0; ringPtr != NULL; ringPtr = ringPtr->next, i++) {
+		ringPtr->colors = colors;
+		fillRingColorsTo(ringPtr, i, colors);
+		colors += ringPtr->particleCount;
+	}
+}
+
+/*
+ * Switch to the given color mode, crossfading over timerColorFade
+ * milliseconds (0 to switch instantly).  The colors currently on screen -
+ * which may themselves be partway through a crossfade - are saved with each
+ * particle and the fade starts from those, so pressing 'm' mid-fade doesn't
+ * jump and overlapping fades cost no more than a single one: the new mode's
+ * lookup and a blend per particle.
+ */
+void startColorModeFade(int mode) {
+	if (timerColorFade > 0) {
+		RingNode *ringPtr = rings;
+		for (int i = 0; ringPtr != NULL; ringPtr = ringPtr->next, i++) {
+			RGB *colors = fillRingColors(ringPtr, i);
+			ParticleNode *particlePtr = ringPtr->particleNode;
+			for (; particlePtr != NULL;
+			    particlePtr = particlePtr->next) {
+				particlePtr->fadeFrom = *colors++;
+				particlePtr->fading = true;
+			}
+		}
+	}
+
+	currentColorMode = mode;
+	colorModeFadeDuration = timerColorFade;
+	colorModeFadeRemaining = timerColorFade;
 }
 
 /*
@@ -591,8 +1129,11 @@ void printControls(FILE *s) {
 	fprintf(s, "- press up / down to modify particle speed\n");
 	fprintf(s, "- press left / right to modify particle line distance factor\n");
 	fprintf(s, "- press 'b' to toggle blank mode\n");
+	fprintf(s, "- press 'd' to dump what each ring cost last frame\n");
 	fprintf(s, "- press 'f' to toggle fading mode\n");
+	fprintf(s, "- press 'h' to toggle the performance HUD\n");
 	fprintf(s, "- press 'l' to toggle particle lines mode\n");
+	fprintf(s, "- press 'o' to toggle the overdraw heatmap\n");
 	fprintf(s, "- press 'm' to toggle color modes\n");
 	fprintf(s, "- press 'r' to randomize colors\n");
 	fprintf(s, "- press 'p' to pause or unpause visuals\n");
@@ -609,6 +1150,38 @@ void printUsage(FILE *s) {
 	    "print this message and exit\n");
 	fprintf(s, "    -p, --paused                    "
 	    "start in the 'paused' state\n");
+	fprintf(s, "    --hud                           "
+	    "start with the performance HUD shown\n");
+	fprintf(s, "    --overdraw                      "
+	    "start with the overdraw heatmap shown\n");
+	fprintf(s, "    --perfCounters                  "
+	    "count hardware events per phase (Linux only)\n");
+	fprintf(s, "    --realtime                      "
+	    "lock memory, pin threads and pace frames precisely\n");
+	fprintf(s, "    --benchmark frames              "
+	    "simulate frames headless and report throughput\n");
+	fprintf(s, "    --benchmarkResults file.jsonl   "
+	    "append the benchmark frame times and build info to file\n");
+	fprintf(s, "    --soak seconds                  "
+	    "simulate seconds headless in fast virtual time, check for leaks\n");
+	fprintf(s, "    --sweep frames                  "
+	    "benchmark frames at every point of a scene size grid as CSV\n");
+	fprintf(s, "                                    "
+	    "(the simulation is single-threaded, there is no thread axis)\n");
+	fprintf(s, "    --verify frames                 "
+	    "check frames headless against the reference implementation\n");
+	fprintf(s, "    --audio file.wav                "
+	    "play the given file while visualizing\n");
+	fprintf(s, "    --analyze file                  "
+	    "write the feature track of --audio to file and exit\n");
+	fprintf(s, "    --featureTrack file             "
+	    "drive the visuals from a precomputed feature track\n");
+	fprintf(s, "    --trace file.json               "
+	    "record a Chrome trace (flushed on exit or SIGUSR1)\n");
+	fprintf(s, "    --metrics file.csv              "
+	    "write per-frame metrics (JSON lines if .json/.jsonl)\n");
+	fprintf(s, "    --telemetry /name               "
+	    "publish stats and accept commands in shared memory\n");
 	fprintf(s, "    --configVariableName value      "
 	    "set a configuration variable, see below\n");
 	fprintf(s, "\n");
@@ -650,6 +1223,47 @@ void parseArguments(char **argv) {
 			} else if (strcmp(arg, "paused") == 0) {
 				paused = true;
 				goto loop;
+			} else if (strcmp(arg, "hud") == 0) {
+				hudEnabled = true;
+				goto loop;
+			} else if (strcmp(arg, "overdraw") == 0) {
+				overdrawMode = true;
+				goto loop;
+			} else if (strcmp(arg, "perfCounters") == 0) {
+				perfCountersEnabled = true;
+				goto loop;
+			} else if (strcmp(arg, "realtime") == 0) {
+				realtimeMode = true;
+				goto loop;
+			} else if (strcmp(arg, "audio") == 0 ||
+			    strcmp(arg, "analyze") == 0 ||
+			    strcmp(arg, "featureTrack") == 0 ||
+			    strcmp(arg, "trace") == 0 ||
+			    strcmp(arg, "metrics") == 0 ||
+			    strcmp(arg, "benchmarkResults") == 0 ||
+			    strcmp(arg, "telemetry") == 0) {
+				// options that take a file name
+				char *file = *(argv + 1);
+				if (file == NULL) {
+					goto error;
+				}
+				if (strcmp(arg, "audio") == 0) {
+					audioFile = file;
+				} else if (strcmp(arg, "analyze") == 0) {
+					analyzeFile = file;
+				} else if (strcmp(arg, "trace") == 0) {
+					traceFile = file;
+				} else if (strcmp(arg, "metrics") == 0) {
+					metricsFile = file;
+				} else if (strcmp(arg, "telemetry") == 0) {
+					telemetryName = file;
+				} else if (strcmp(arg, "benchmarkResults") == 0) {
+					benchmarkResultsFile = file;
+				} else {
+					featureTrackFile = file;
+				}
+				argv++;
+				goto loop;
 			}
 
 			/*
@@ -666,16 +1280,49 @@ void parseArguments(char **argv) {
 			}
 
 			// ensure the int parsed
-			if (next == NULL || next == end || errno != 0 || num < 0) {
+			if (next == NULL || next == end || errno != 0) {
 				fprintf(stderr, "failed to parse '%s'\n", next);
 				goto error;
 			}
 
+			// options that take a number but aren't configuration
+			if (num < 0 && (strcmp(arg, "benchmark") == 0 ||
+			    strcmp(arg, "soak") == 0 ||
+			    strcmp(arg, "sweep") == 0 ||
+			    strcmp(arg, "verify") == 0)) {
+				fprintf(stderr, "'%s' must not be negative\n",
+				    next);
+				goto error;
+			}
+			if (strcmp(arg, "benchmark") == 0) {
+				benchmarkFrames = num;
+				argv++;
+				goto loop;
+			} else if (strcmp(arg, "soak") == 0) {
+				soakSeconds = num;
+				argv++;
+				goto loop;
+			} else if (strcmp(arg, "sweep") == 0) {
+				sweepFrames = num;
+				argv++;
+				goto loop;
+			} else if (strcmp(arg, "verify") == 0) {
+				verifyFrames = num;
+				argv++;
+				goto loop;
+			}
+
 			// loop over all config options as long opts
 			struct ConfigurationParameter *ptr = config;
 			while (ptr->name != NULL) {
 				assert(ptr->value != NULL);
 				if (strcmp(arg, ptr->name) == 0) {
+					if (num < ptr->minimum) {
+						fprintf(stderr, "%s must be at "
+						    "least %d\n", ptr->name,
+						    ptr->minimum);
+						goto error;
+					}
 					*(ptr->value) = num;
 					break;
 				}
@@ -717,13 +1364,48 @@ error:
 	exit(1);
 }
 
+/*
+ * Print what each ring cost during the last frame (innermost ring first), to
+ * see which rings dominate the frame
+ */
+void dumpRingStats() {
+	double usPerTick = 1e6 / SDL_GetPerformanceFrequency();
+	RingStats total;
+
+	memset(&total, 0, sizeof (total));
+	logPrintf(stdout, "%4s %9s %5s %7s %6s %9s %9s %9s %9s\n",
+	    "ring", "particles", "born", "pairs", "lines", "minHeight",
+	    "maxHeight", "update_us", "lines_us");
+
+	RingNode *ringPtr = rings;
+	for (int i = 0; ringPtr != NULL; ringPtr = ringPtr->next, i++) {
+		RingStats *stats = &ringPtr->stats;
+
+		logPrintf(stdout, "%4d %9u %5u %7u %6u %9.1f %9.1f %9.2f "
+		    "%9.2f\n", i, ringPtr->particleCount, stats->born,
+		    stats->pairsTested, stats->linesDrawn,
+		    stats->minHeight == INFINITY ? 0 : stats->minHeight,
+		    stats->maxHeight, stats->updateTicks * usPerTick,
+		    stats->lineTicks * usPerTick);
+
+		total.born += stats->born;
+		total.pairsTested += stats->pairsTested;
+		total.linesDrawn += stats->linesDrawn;
+		total.updateTicks += stats->updateTicks;
+		total.lineTicks += stats->lineTicks;
+	}
+
+	logPrintf(stdout, "%4s %9u %5u %7u %6u %9s %9s %9.2f %9.2f\n",
+	    "all", particleCount - recycledParticles, total.born,
+	    total.pairsTested, total.linesDrawn, "", "",
+	    total.updateTicks * usPerTick, total.lineTicks * usPerTick);
+}
+
 /*
  * Process SDL and keyboard events
  */
 void processEvents() {
 	SDL_Event Event;
-	SDL_Window *window;
-	int i;
 	while (SDL_PollEvent(&Event)) {
 		switch (Event.type) {
 		case SDL_QUIT:
@@ -734,11 +1416,26 @@ void processEvents() {
 			case SDL_WINDOWEVENT_SIZE_CHANGED:
 				windowWidth = Event.window.data1;
 				windowHeight = Event.window.data2;
-				window = SDL_GetWindowFromID(Event.window.windowID);
 				resetWindow(window);
-				printf("window size changed to %dx%d\n",
+				logPrintf(stdout,
+				    "window size changed to %dx%d\n",
 				    windowWidth, windowHeight);
 				break;
+			case SDL_WINDOWEVENT_HIDDEN:
+			case SDL_WINDOWEVENT_MINIMIZED:
+				windowHidden = true;
+				break;
+			case SDL_WINDOWEVENT_SHOWN:
+			case SDL_WINDOWEVENT_RESTORED:
+			case SDL_WINDOWEVENT_MAXIMIZED:
+				windowHidden = false;
+				break;
+			case SDL_WINDOWEVENT_FOCUS_GAINED:
+				windowFocused = true;
+				break;
+			case SDL_WINDOWEVENT_FOCUS_LOST:
+				windowFocused = false;
+				break;
 			}
 			break;
 		case SDL_KEYDOWN:
@@ -748,72 +1445,86 @@ void processEvents() {
 				break;
 			case SDLK_UP:
 				particleSpeedFactor++;
-				printf("particleSpeedFactor=%d\n",
+				logPrintf(stdout, "particleSpeedFactor=%d\n",
 				    particleSpeedFactor);
 				break;
 			case SDLK_DOWN:
 				if (particleSpeedFactor > 0) {
 					particleSpeedFactor--;
 				}
-				printf("particleSpeedFactor=%d\n",
+				logPrintf(stdout, "particleSpeedFactor=%d\n",
 				    particleSpeedFactor);
 				break;
 			case SDLK_LEFT:
 				if (particleLineDistanceFactor > 0) {
 					particleLineDistanceFactor--;
 				}
-				printf("particleLineDistanceFactor=%d\n",
+				logPrintf(stdout,
+				    "particleLineDistanceFactor=%d\n",
 				    particleLineDistanceFactor);
 				break;
 			case SDLK_RIGHT:
 				particleLineDistanceFactor++;
-				printf("particleLineDistanceFactor=%d\n",
+				logPrintf(stdout,
+				    "particleLineDistanceFactor=%d\n",
 				    particleLineDistanceFactor);
 				break;
 			case SDLK_b:
 				// b = blank
 				blankMode = !blankMode;
-				printf("blank %s\n",
+				logPrintf(stdout, "blank %s\n",
 				    blankMode ? "enabled" : "disabled");
 				break;
 			case SDLK_c:
 				// c = clear
-				i = 0;
-				while (ringCount > 0) {
-					recycleLastRing();
-					ringCount--;
-					i++;
-				}
-				printf("cleared %d rings\n", i);
+				logPrintf(stdout, "cleared %d rings\n",
+				    clearRings());
+				break;
+			case SDLK_d:
+				// d = dump ring stats
+				dumpRingStats();
 				break;
 			case SDLK_f:
 				// f = fading
 				fadingMode = !fadingMode;
-				printf("fading %s\n",
+				logPrintf(stdout, "fading %s\n",
 				    fadingMode ? "enabled" : "disabled");
 				break;
+			case SDLK_h:
+				// h = HUD
+				hudEnabled = !hudEnabled;
+				logPrintf(stdout, "hud %s\n",
+				    hudEnabled ? "enabled" : "disabled");
+				break;
 			case SDLK_l:
 				// l = lines
 				linesEnabled = !linesEnabled;
-				printf("lines %s\n",
+				logPrintf(stdout, "lines %s\n",
 				    linesEnabled ? "enabled" : "disabled");
 				break;
 			case SDLK_m:
 				// m = color mode
-				currentColorMode = (currentColorMode + 1) % 4;
-				printf("currentColorMode = %s\n",
-				    colorModeToString(currentColorMode));
+				startColorModeFade((currentColorMode + 1) %
+				    NUM_COLOR_MODES);
+				logPrintf(stdout, "currentColorMode = %s\n",
+				    colorModes[currentColorMode].name);
+				break;
+			case SDLK_o:
+				// o = overdraw
+				overdrawMode = !overdrawMode;
+				logPrintf(stdout, "overdraw %s\n",
+				    overdrawMode ? "enabled" : "disabled");
 				break;
 			case SDLK_p:
 				// p = play/pause
 				paused = !paused;
-				printf("%s\n",
+				logPrintf(stdout, "%s\n",
 				    paused ? "paused" : "unpaused");
 				break;
 			case SDLK_r:
 				// r = randomize colors
-				randomizeMagic(randomMagic);
-				printf("randomized colors\n");
+				randomizeColors(timerColorFade);
+				logPrintf(stdout, "randomized colors\n");
 				break;
 			default:
 				break;
@@ -826,20 +1537,1689 @@ void processEvents() {
 }
 
 /*
- * Main method!
+ * Apply the latest audio features (if music is playing) to the simulation
  */
-int main(int argc, char **argv) {
-	float rainbowIdx = 0;
-	int addNewRingCounter = 0;
-	int printStatusLineCounter = 0;
-	unsigned int lastTime = 0;
+#define AUDIO_BASS_SMOOTHING 0.02
+void applyAudioFeatures() {
+	AudioFeatures features;
 
-	// parse CLI options
-	parseArguments(argv);
+	audioSpeedScale = 1.0;
+	audioColorScale = 1.0;
 
-	// initalize SDL and OpenGL window
-	SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
-	SDL_Window *window = SDL_CreateWindow("Undercurrents", 0, 0,
+	if (audioReactivity == 0) {
+		return;
+	}
+
+	if (featureTrack != NULL) {
+		// precomputed - look up the frame for the current time
+		unsigned long idx;
+		const FeatureTrackFrame *frame = featureTrackFrame(featureTrack,
+		    timebase.last, &idx);
+
+		features.hop = idx + 1;
+		features.level = frame->level;
+		memcpy(features.bands, frame->bands, sizeof (features.bands));
+		features.flux = frame->flux;
+		features.onset = frame->onset;
+	} else if (audio != NULL) {
+		audioGetFeatures(audio, &features);
+		if (features.hop == 0) {
+			return;
+		}
+	} else {
+		return;
+	}
+
+	float r = audioReactivity / 100.0;
+	float bass = (features.bands[0] + features.bands[1]) / 2;
+	float boost = bass - audioBassAverage;
+
+	audioSpeedScale = 1.0 + r * 4.0 * (boost > 0 ? boost : 0);
+	audioColorScale = 1.0 + r * 4.0 * features.level;
+
+	// only act on each hop once
+	if (features.hop != lastAudioHop) {
+		lastAudioHop = features.hop;
+		audioBassAverage += AUDIO_BASS_SMOOTHING *
+		    (bass - audioBassAverage);
+		if (features.onset) {
+			addNewRingCounter = 0;
+		}
+	}
+}
+
+/*
+ * Clear (or fade, when fading mode is enabled) the screen
+ */
+void clearScreen() {
+	float alpha = fadingMode ? ((float)alphaBackground / 100.0) : 1.0;
+	gpuTimerBegin(gpuTimer, GpuPassFade);
+	if (overdrawMode) {
+		glColor4f(OVERDRAW_UNIT, OVERDRAW_UNIT, OVERDRAW_UNIT, 1.0f);
+	} else {
+		glColor4f(0.0f, 0.0f, 0.0f, alpha);
+	}
+	glRecti(0, 0, windowWidth, windowHeight);
+	gpuTimerEnd(gpuTimer, GpuPassFade);
+
+	profilerCount(CounterStateChanges, 1);
+	profilerCount(CounterDrawCalls, 1);
+	profilerCount(CounterVertices, 4);
+}
+
+/*
+ * Advance the simulation by delta milliseconds: add new rings (and particles)
+ * when needed, cycle the colors and move every particle.
+ */
+void updateScene(unsigned int delta) {
+	RingNode *ringPtr;
+
+	// check if new ring (and particles) should be created
+	addNewRingCounter -= delta;
+	if (addNewRingCounter <= 0) {
+		addNewRingCounter += timerAddNewRing;
+
+		// add a new ring
+		addRing();
+
+		// recycle out-of-view rings
+		while (ringCount > ringsMaximum) {
+			recycleLastRing();
+			ringCount--;
+		}
+
+		// add particle(s) to each existing ring
+		ringPtr = rings;
+		for (int i = 0; ringPtr != NULL; ringPtr = ringPtr->next, i++) {
+			/*
+			 * Calculate how many particles to add
+			 *
+			 * I'd like to make this function somehow more
+			 * configurable.  The basic idea is that 'i' is
+			 * the number of the current ring being
+			 * processed, where 0 is always the innermost
+			 * ring and the number increments as we loop
+			 * towards the more outside rings.
+			 */
+			int num = ((i / 4) + 4) * particleSpawnFactor / 100;
+
+			for (int j = 0; j < num; j++) {
+				ParticleNode *head = ringPtr->particleNode;
+				ParticleNode *new = makeOrReclaimRandomizedParticleNode();
+
+				if (head != NULL) {
+					assert(head->particle);
+					/*
+					 * We use one of the particles
+					 * existing height as an offset
+					 * for the newly calculated
+					 * particle.  This is a little
+					 * sus but it works.
+					 */
+					new->particle->height += head->particle->height;
+				}
+
+				new->next = head;
+				ringPtr->particleNode = new;
+				ringPtr->particleCount++;
+			}
+		}
+
+		int i = 0;
+		while (addNewRingCounter <= 0) {
+			i++;
+			addNewRingCounter += timerAddNewRing;
+		}
+		if (i > 0) {
+			logPrintf(stderr,
+			    "[warn] missed %d add ring calls\n", i);
+		}
+	}
+
+	// Update rainbow index
+	rainbowIdx += (float)delta / 1000.0 * particleColorSpeed *
+	    audioColorScale;
+	while (rainbowIdx > MAX_COLORS) { rainbowIdx -= MAX_COLORS; }
+	while (rainbowIdx <= 0) { rainbowIdx += MAX_COLORS; }
+
+	// advance any color crossfades
+	paletteFadeUpdate(&palette, delta);
+	if (colorModeFadeRemaining > 0) {
+		colorModeFadeRemaining -= delta < colorModeFadeRemaining ?
+		    delta : colorModeFadeRemaining;
+	}
+
+	// calculate new particle locations
+	ringPtr = rings;
+	for (; ringPtr != NULL; ringPtr = ringPtr->next) {
+		ParticleNode *particlePtr = ringPtr->particleNode;
+		RingStats *stats = &ringPtr->stats;
+		Uint64 start = SDL_GetPerformanceCounter();
+
+		// the line pass counts again after this
+		stats->born = 0;
+		stats->pairsTested = 0;
+		stats->linesDrawn = 0;
+		stats->minHeight = INFINITY;
+		stats->maxHeight = 0;
+		stats->lineTicks = 0;
+
+		// loop particles in ring
+		for (; particlePtr != NULL; particlePtr = particlePtr->next) {
+			Particle *p = particlePtr->particle;
+
+			float speedRate = particleSpeedFactor / 100.0 *
+			    audioSpeedScale;
+
+			// update particle location
+			p->height += (float)delta * (float)particleExpandRate / 1000.0;
+			p->position += (float)delta * ((float)p->speed / p->height / 5.0 * speedRate);
+			particleCalculateCoordinates(p);
+
+			// reduce bornTimer by delta
+			if (p->bornTimer != 0) {
+				p->bornTimer -= delta;
+				if (p->bornTimer <= 0) {
+					p->bornTimer = 0;
+					frameStats.born++;
+				}
+			}
+
+			if (p->bornTimer == 0) {
+				stats->born++;
+			}
+			if (p->height < stats->minHeight) {
+				stats->minHeight = p->height;
+			}
+			if (p->height > stats->maxHeight) {
+				stats->maxHeight = p->height;
+			}
+		}
+
+		stats->updateTicks = SDL_GetPerformanceCounter() - start;
+	}
+}
+
+/*
+ * Set the color, unless it is the same as the last one set this pass
+ */
+static void setPassColor(RGB rgb, RGB *lastColor) {
+	if (rgb.r != lastColor->r || rgb.g != lastColor->g ||
+	    rgb.b != lastColor->b) {
+		setColorRGB(rgb, alphaElements);
+		*lastColor = rgb;
+	}
+}
+
+/*
+ * Draw every born particle in this frame's colors (see fillFrameColors())
+ */
+void drawParticles() {
+	// an impossible color so the first particle always sets it
+	RGB lastColor = { -1, -1, -1 };
+
+	RingNode *ringPtr = rings;
+	for (; ringPtr != NULL; ringPtr = ringPtr->next) {
+		ParticleNode *particlePtr = ringPtr->particleNode;
+		RGB *colors = ringPtr->colors;
+		int j = 0;
+
+		// loop particles in ring
+		for (; particlePtr != NULL; particlePtr = particlePtr->next, j++) {
+			Particle *p = particlePtr->particle;
+
+			// check if particle is born
+			if (p->bornTimer > 0) {
+				continue;
+			}
+
+			setPassColor(colors[j], &lastColor);
+			DrawParticle(p);
+		}
+	}
+}
+
+/*
+ * If two particles of a ring are close enough to be connected by a line
+ */
+bool particlesConnected(Particle *p, Particle *p2) {
+	float yd = p2->y -p->y;
+	float xd = p2->x -p->x;
+
+	// distance between 2 particles
+	float d = sqrt((xd * xd) + (yd * yd));
+
+	float maxDistance = (float)p->lineDistance * (particleLineDistanceFactor / 100.0);
+
+	return d < maxDistance;
+}
+
+/*
+ * Called by ringLines() for every pair of particles to connect, j and k being
+ * their positions in the ring
+ */
+typedef void (*RingLineFunc)(Particle *p, Particle *p2, int j, int k,
+    void *arg);
+
+/*
+ * The line pass of a ring: find every pair of born particles close enough to
+ * be connected by a line and call fn with it.  Returns the number of pairs
+ * tested.  Drawing, the headless modes and --verify all find their lines
+ * here, so this is the one place a faster search has to go.
+ */
+unsigned int ringLines(RingNode *ring, RingLineFunc fn, void *arg) {
+	unsigned int pairs = 0;
+	int j = 0;
+
+	for (ParticleNode *a = ring->particleNode; a != NULL;
+	    a = a->next, j++) {
+		Particle *p = a->particle;
+
+		if (p->bornTimer > 0) {
+			continue;
+		}
+
+		// test against every particle NEXT in the ring/orbit
+		int k = j + 1;
+		for (ParticleNode *b = a->next; b != NULL; b = b->next, k++) {
+			Particle *p2 = b->particle;
+
+			if (p2->bornTimer > 0) {
+				continue;
+			}
+			pairs++;
+
+			if (particlesConnected(p, p2)) {
+				fn(p, p2, j, k, arg);
+			}
+		}
+	}
+
+	return pairs;
+}
+
+void countRingLine(Particle *p, Particle *p2, int j, int k, void *arg) {
+	(*(unsigned int *)arg)++;
+}
+
+/*
+ * Count the lines drawLines() would draw for a ring without drawing them,
+ * adding the number of pairs tested to pairs (headless modes)
+ */
+unsigned int countRingLines(RingNode *ring, unsigned long *pairs) {
+	unsigned int lines = 0;
+
+	*pairs += ringLines(ring, countRingLine, &lines);
+
+	return lines;
+}
+
+/*
+ * What drawRingLine() needs to draw the lines of a ring
+ */
+typedef struct DrawLinesState {
+	RGB *colors;
+	RGB lastColor;
+	RingStats *stats;
+} DrawLinesState;
+
+void drawRingLine(Particle *p, Particle *p2, int j, int k, void *arg) {
+	DrawLinesState *state = arg;
+
+	setPassColor(state->colors[j], &state->lastColor);
+	DrawLinesConnectingParticles(p, p2);
+	state->stats->linesDrawn++;
+}
+
+/*
+ * Draw lines between born particles in the same ring that are close enough,
+ * in the color of the first particle of each pair (the colors the particle
+ * pass filled, see fillFrameColors())
+ */
+void drawLines() {
+	DrawLinesState state;
+
+	state.lastColor.r = -1;
+	state.lastColor.g = -1;
+	state.lastColor.b = -1;
+
+	RingNode *ringPtr = rings;
+	for (int i = 0; ringPtr != NULL; ringPtr = ringPtr->next, i++) {
+		// check if this ring has lines disabled
+		if (particleLineRingDisable != -1 && i > particleLineRingDisable) {
+			break;
+		}
+
+		RingStats *stats = &ringPtr->stats;
+		Uint64 start = SDL_GetPerformanceCounter();
+
+		state.colors = ringPtr->colors;
+		state.stats = stats;
+		stats->pairsTested += ringLines(ringPtr, drawRingLine, &state);
+
+		frameStats.pairsTested += stats->pairsTested;
+		stats->lineTicks = SDL_GetPerformanceCounter() - start;
+	}
+}
+
+/*
+ * Draw every born particle and then the lines connecting them, each pass
+ * profiled as its own phase and timed on the GPU.  The colors are filled
+ * once, as part of the particle pass, and reused for the lines.
+ */
+void drawScene() {
+	profilerBegin(PhaseDraw);
+	fillFrameColors();
+	gpuTimerBegin(gpuTimer, GpuPassParticles);
+	drawParticles();
+	gpuTimerEnd(gpuTimer, GpuPassParticles);
+	profilerEnd(PhaseDraw);
+
+	if (!linesEnabled) {
+		return;
+	}
+
+	profilerBegin(PhaseLines);
+	gpuTimerBegin(gpuTimer, GpuPassLines);
+	drawLines();
+	gpuTimerEnd(gpuTimer, GpuPassLines);
+	profilerEnd(PhaseLines);
+}
+
+/*
+ * Hand the last complete frame to the metrics writer and start counting the
+ * next one.  Called at the start of every frame, so the scene state recorded
+ * is what the last frame drew.
+ */
+void recordMetrics() {
+	const ProfilerFrame *frame = profilerLastFrame();
+
+	if (metrics != NULL && frame->frameTime > 0) {
+		MetricsRecord record;
+
+		record.timestamp = timebase.last;
+		record.frameTime = frame->frameTime;
+		for (int i = 0; i < PHASE_COUNT; i++) {
+			record.phases[i] = frame->phases[i];
+		}
+		record.ringCount = ringCount;
+		record.particleCount = particleCount;
+		record.recycledParticles = recycledParticles;
+		record.born = frameStats.born;
+		record.pairsTested = frameStats.pairsTested;
+		record.linesDrawn = frameStats.linesDrawn;
+		for (int i = 0; i < COUNTER_COUNT; i++) {
+			record.counts[i] = frame->counts[i];
+		}
+		for (int i = 0; i < GPU_PASS_COUNT; i++) {
+			record.gpu[i] = frame->gpu[i];
+		}
+		for (int i = 0; i < ALLOC_SUBSYSTEM_COUNT; i++) {
+			const AllocStats *stats = allocStats(i);
+			record.allocs[i] = stats->frameAllocations;
+			record.allocBytes[i] = stats->frameBytes;
+			record.live[i] = stats->live;
+		}
+		record.overdraw = 0;
+		record.overdrawP99 = 0;
+		if (overdrawMode) {
+			record.overdraw = overdraw->total;
+			record.overdrawP99 = overdraw->p99;
+		}
+
+		metricsRecord(metrics, &record);
+	}
+
+	memset(&frameStats, 0, sizeof (frameStats));
+	allocFrameBegin();
+}
+
+/*
+ * Set a configuration variable or mode by name, as sent by another process
+ * through the telemetry block.  Returns false if there is no such name or
+ * the value is out of range.  Setting windowWidth or windowHeight resizes
+ * the window (to whatever size the window manager allows).
+ */
+bool setNamedValue(const char *name, int value) {
+	bool *flags[] = { &linesEnabled, &fadingMode, &blankMode, &paused,
+	    &hudEnabled, &overdrawMode };
+	const char *flagNames[] = { "linesEnabled", "fadingMode", "blankMode",
+	    "paused", "hudEnabled", "overdrawMode" };
+
+	for (unsigned int i = 0; i < sizeof (flags) / sizeof (flags[0]); i++) {
+		if (strcmp(name, flagNames[i]) == 0) {
+			*flags[i] = value != 0;
+			return true;
+		}
+	}
+
+	if (strcmp(name, "currentColorMode") == 0) {
+		if (value < 0 || value >= NUM_COLOR_MODES) {
+			return false;
+		}
+		if (value != currentColorMode) {
+			startColorModeFade(value);
+		}
+		return true;
+	}
+
+	// same rules as the command line
+	struct ConfigurationParameter *ptr = config;
+	for (; ptr->name != NULL; ptr++) {
+		if (strcmp(name, ptr->name) == 0) {
+			if (value < ptr->minimum) {
+				return false;
+			}
+			*ptr->value = value;
+
+			// the window follows its size
+			if (window != NULL && (ptr->value == &windowWidth ||
+			    ptr->value == &windowHeight)) {
+				SDL_SetWindowSize(window, windowWidth,
+				    windowHeight);
+				SDL_GetWindowSize(window, &windowWidth,
+				    &windowHeight);
+				resetWindow(window);
+			}
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Apply every command queued in the telemetry block since the last frame
+ */
+void applyTelemetryCommands() {
+	char name[TELEMETRY_NAME_SIZE];
+	int32_t value;
+
+	while (telemetryPoll(telemetry, name, &value)) {
+		if (setNamedValue(name, value)) {
+			telemetryCommandsApplied++;
+			logPrintf(stdout, "telemetry: %s=%d\n", name, value);
+		} else {
+			telemetryCommandsRejected++;
+			logPrintf(stderr, "[warn] telemetry: rejected %s=%d\n",
+			    name, value);
+		}
+	}
+}
+
+/*
+ * Publish the last complete frame to the telemetry block
+ */
+void publishTelemetry() {
+	static uint64_t frames = 0;
+	const ProfilerFrame *frame = profilerLastFrame();
+	TelemetryStats stats;
+
+	memset(&stats, 0, sizeof (stats));
+	stats.frame = ++frames;
+	stats.time = timebase.last;
+	stats.frameTime = frame->frameTime;
+	stats.fps = frame->frameTime > 0 ? 1000.0 / frame->frameTime : 0;
+	for (int i = 0; i < PHASE_COUNT && i < TELEMETRY_PHASES; i++) {
+		stats.phases[i] = frame->phases[i];
+	}
+	stats.ringCount = ringCount;
+	stats.particleCount = particleCount;
+	stats.recycledParticles = recycledParticles;
+	stats.linesDrawn = frameStats.linesDrawn;
+	stats.drawCalls = frame->counts[CounterDrawCalls];
+	stats.vertices = frame->counts[CounterVertices];
+	stats.colorMode = currentColorMode;
+	stats.linesEnabled = linesEnabled;
+	stats.fadingMode = fadingMode;
+	stats.blankMode = blankMode;
+	stats.paused = paused;
+	stats.commandsApplied = telemetryCommandsApplied;
+	stats.commandsRejected = telemetryCommandsRejected;
+
+	telemetryPublish(telemetry, &stats);
+}
+
+void stopTelemetry() {
+	telemetryClose(telemetry, telemetryName, true);
+	telemetry = NULL;
+}
+
+/*
+ * Enter the allocation steady state (see alloc.h) once allocationWarmup
+ * milliseconds have passed on the simulation clock
+ */
+void checkAllocationWarmup() {
+	if (allocationWarmup <= 0 || allocSteadyState() ||
+	    timebase.last * 1000 < allocationWarmup) {
+		return;
+	}
+
+	allocSetSteadyState(true);
+	logPrintf(stdout, "allocation steady state after %dms: %ld particles, "
+	    "%ld rings\n", allocationWarmup,
+	    allocStats(AllocParticles)->live, allocStats(AllocRings)->live);
+}
+
+/*
+ * Draw the performance HUD in the top left corner: frame rate, what the last
+ * frame drew, the current modes, the frame-time graph and phase bars.
+ */
+void drawHud() {
+	const ProfilerFrame *frame = profilerLastFrame();
+
+	hudBegin(hud);
+	hudPrintf(hud, "fps %.1f frame %.2fms",
+	    frame->frameTime > 0 ? 1000.0 / frame->frameTime : 0,
+	    frame->frameTime);
+	hudPrintf(hud, "rings %u particles %u", ringCount, particleCount);
+	hudPrintf(hud, "lines %u pairs %u", frameStats.linesDrawn,
+	    frameStats.pairsTested);
+	hudPrintf(hud, "draws %lu verts %lu",
+	    frame->counts[CounterDrawCalls], frame->counts[CounterVertices]);
+	hudPrintf(hud, "state changes %lu",
+	    frame->counts[CounterStateChanges]);
+	if (gpuTimer != NULL) {
+		// fade, particle and line passes
+		hudPrintf(hud, "gpu %.2f %.2f %.2f ms",
+		    frame->gpu[GpuPassFade], frame->gpu[GpuPassParticles],
+		    frame->gpu[GpuPassLines]);
+	} else {
+		hudPrintf(hud, "gpu n/a");
+	}
+	hudPrintf(hud, "mode %s", colorModes[currentColorMode].name);
+	if (overdrawMode) {
+		hudPrintf(hud, "frags %llu %.2f/px", overdraw->total,
+		    (double)overdraw->total / (windowWidth * windowHeight));
+		hudPrintf(hud, "overdraw p99 %u max %u", overdraw->p99,
+		    overdraw->maximum);
+	}
+	hudPrintf(hud, "clock %s%s", timebaseSourceToString(timebase.source),
+	    paused ? " paused" : blankMode ? " blank" : "");
+	hudPrintf(hud, "fade %s lines %s log drops %lu",
+	    fadingMode ? "on" : "off", linesEnabled ? "on" : "off",
+	    logDropped());
+	hudEnd(hud);
+}
+
+/*
+ * Percentage of a CPU used by the whole process (every thread, user and
+ * system time) since the last call
+ */
+double cpuUsage() {
+	static double lastCpu = 0;
+	static double lastWall = 0;
+	struct rusage usage;
+	double percent = 0;
+
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+
+	double cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+	    usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+	double wall = timebaseWallNow();
+	if (lastWall > 0 && wall > lastWall) {
+		percent = 100.0 * (cpu - lastCpu) / (wall - lastWall);
+	}
+
+	lastCpu = cpu;
+	lastWall = wall;
+	return percent;
+}
+
+/*
+ * Print the status line.  The whole line is formatted first and queued as a
+ * single log message so it can't be split up if the log ring fills.
+ */
+void printStatusLine() {
+	char line[LOG_MESSAGE_SIZE];
+	size_t len;
+
+	// (fps from the frame time, delta is simulation time)
+	double frameTime = profilerLastFrame()->frameTime;
+	len = snprintf(line, sizeof (line), "fps=%f cpu=%.1f%% ringCount=%u "
+	    "particleCount=%u recycledParticles=%u",
+	    frameTime > 0 ? 1000.0 / frameTime : 0, cpuUsage(), ringCount,
+	    particleCount, recycledParticles);
+	if (audio != NULL && len < sizeof (line)) {
+		AudioFeatures features;
+		audioGetFeatures(audio, &features);
+		len += snprintf(line + len, sizeof (line) - len,
+		    " audio=%.1fs level=%.3f overflows=%lu underflows=%lu",
+		    audioTime(audio), features.level,
+		    atomic_load(&audio->overflows),
+		    atomic_load(&audio->underflows));
+	}
+	if (timebase.source == TimebaseAudio && len < sizeof (line)) {
+		len += snprintf(line + len, sizeof (line) - len,
+		    " drift=%+.1fms skew=%+.1fms",
+		    timebaseDrift(&timebase) * 1000,
+		    timebaseSkew(&timebase) * 1000);
+	}
+	if (overdrawMode && len < sizeof (line)) {
+		len += snprintf(line + len, sizeof (line) - len,
+		    " overdraw=%llu p99=%u max=%u", overdraw->total,
+		    overdraw->p99, overdraw->maximum);
+	}
+
+	logPrintf(stdout, "%s\n", line);
+}
+
+/*
+ * Soak mode: simulate soakSeconds of virtual time headless as fast as
+ * possible while churning the scene the way a long show does - every
+ * SOAK_STEP simulated seconds the next row of soakSteps is applied, the
+ * colors are randomized and the color mode is changed, and the rings are
+ * cleared every SOAK_CLEAR seconds.  One pass over soakSteps is a cycle.
+ *
+ * After every cycle the RSS, the size of the particle and ring pools and the
+ * mean wall clock cost of a frame (updating the scene and filling the colors
+ * of every ring, what drawing costs on the CPU) are recorded.  Every pool
+ * size has been reached by the end of the first cycle, so the run fails if
+ * a pool or the RSS grows after it or if the frame cost of the last quarter
+ * of the cycles is more than SOAK_COST_GROWTH times that of the first
+ * quarter.  Returns the exit status.
+ *
+ * With --telemetry, stats are published and commands applied every frame, so
+ * a soak can also be driven from another process (see ucctl).
+ */
+#define SOAK_FRAME_TIME 16
+#define SOAK_STEP 60
+#define SOAK_CLEAR 97
+#define SOAK_REPORT 3600
+#define SOAK_RSS_SLACK 1024
+#define SOAK_COST_GROWTH 1.5
+struct SoakStep {
+	int ringsMaximum;
+	int particleSpeedFactor;
+	int timerAddNewRing;
+	int particleColorSpeed;
+};
+static const struct SoakStep soakSteps[] = {
+	{ RINGS_MAXIMUM, PARTICLE_SPEED_FACTOR, TIMER_ADD_NEW_RING,
+	    PARTICLE_COLOR_SPEED },
+	{ 10, 400, 250, 200 },
+	{ 60, 50, 500, 10 },
+	{ 1, 1000, 100, 1000 },
+	{ 45, 0, 2000, 0 },
+	{ 20, 200, 50, 50 }
+};
+#define NUM_SOAK_STEPS (sizeof (soakSteps) / sizeof (soakSteps[0]))
+int runSoak() {
+	unsigned long frames = (unsigned long)soakSeconds * 1000 /
+	    SOAK_FRAME_TIME;
+	unsigned long framesPerStep = SOAK_STEP * 1000 / SOAK_FRAME_TIME;
+	unsigned long framesPerClear = SOAK_CLEAR * 1000 / SOAK_FRAME_TIME;
+	unsigned long framesPerCycle = framesPerStep * NUM_SOAK_STEPS;
+	unsigned long framesPerReport = SOAK_REPORT * 1000 / SOAK_FRAME_TIME;
+	unsigned long cycles = frames / framesPerCycle;
+	double freq = SDL_GetPerformanceFrequency();
+	double wallStart = timebaseWallNow();
+
+	if (cycles < 2) {
+		warnx("soak needs at least 2 cycles (%lu simulated seconds)",
+		    2 * framesPerCycle * SOAK_FRAME_TIME / 1000);
+		return 2;
+	}
+
+	double *cycleCost = malloc(cycles * sizeof (double));
+	if (cycleCost == NULL) {
+		err(2, "runSoak malloc");
+	}
+
+	srand(1);
+	randomizeColors(0);
+	timebaseInit(&timebase, TimebaseVirtual, NULL);
+
+	unsigned long rssWarm = 0;
+	unsigned int particlesWarm = 0;
+	unsigned int ringsWarm = 0;
+	Uint64 cost = 0;
+	int status = 0;
+
+	printf("soak seconds=%d frames=%lu cycles=%lu\n", soakSeconds, frames,
+	    cycles);
+
+	for (unsigned long frame = 0; frame < cycles * framesPerCycle;
+	    frame++) {
+		// churn the scene
+		if (frame % framesPerStep == 0) {
+			const struct SoakStep *step =
+			    &soakSteps[frame / framesPerStep % NUM_SOAK_STEPS];
+			ringsMaximum = step->ringsMaximum;
+			particleSpeedFactor = step->particleSpeedFactor;
+			timerAddNewRing = step->timerAddNewRing;
+			particleColorSpeed = step->particleColorSpeed;
+
+			randomizeColors(timerColorFade);
+			startColorModeFade((currentColorMode + 1) %
+			    NUM_COLOR_MODES);
+		}
+		if (frame % framesPerClear == framesPerClear - 1) {
+			clearRings();
+		}
+
+		// commands from other processes land between frames, as they
+		// do when running normally
+		if (telemetry != NULL) {
+			publishTelemetry();
+			applyTelemetryCommands();
+		}
+
+		// one frame
+		timebaseAdvance(&timebase, SOAK_FRAME_TIME / 1000.0);
+		Uint64 start = SDL_GetPerformanceCounter();
+		updateScene(timebaseTick(&timebase));
+		fillFrameColors();
+		cost += SDL_GetPerformanceCounter() - start;
+
+		if ((frame + 1) % framesPerCycle != 0) {
+			continue;
+		}
+
+		// end of a cycle: the list and the counters must agree
+		unsigned long cycle = frame / framesPerCycle;
+		unsigned int listed = 0;
+		unsigned int live = 0;
+		for (RingNode *ringPtr = rings; ringPtr != NULL;
+		    ringPtr = ringPtr->next) {
+			listed++;
+			live += ringPtr->particleCount;
+		}
+		if (listed != ringCount ||
+		    live + recycledParticles != particleCount) {
+			warnx("soak: counters out of sync at cycle %lu: "
+			    "ringCount=%u (%u listed) particleCount=%u "
+			    "(%u live + %u recycled)", cycle, ringCount, listed,
+			    particleCount, live, recycledParticles);
+			status = 1;
+			break;
+		}
+
+		cycleCost[cycle] = cost / freq / framesPerCycle * 1e6;
+		cost = 0;
+
+		unsigned long rss = metricsRss();
+		unsigned int ringPool = ringCount + recycledRings;
+		if (cycle == 0) {
+			rssWarm = rss;
+			particlesWarm = particleCount;
+			ringsWarm = ringPool;
+		}
+
+		if ((frame + 1) % framesPerReport < framesPerCycle ||
+		    cycle == cycles - 1) {
+			unsigned long t = (frame + 1) * SOAK_FRAME_TIME / 1000;
+			printf("  t=%02lu:%02lu:%02lu rss=%lukB ringPool=%u "
+			    "particlePool=%u live=%u frameCost=%.2fus "
+			    "wall=%.1fs\n", t / 3600, t / 60 % 60, t % 60, rss,
+			    ringPool, particleCount, live, cycleCost[cycle],
+			    timebaseWallNow() - wallStart);
+			fflush(stdout);
+		}
+	}
+
+	// growth after the first cycle
+	if (status == 0) {
+		unsigned long rss = metricsRss();
+		unsigned int ringPool = ringCount + recycledRings;
+		unsigned long quarter = cycles / 4 > 0 ? cycles / 4 : 1;
+		double first = 0;
+		double last = 0;
+		for (unsigned long i = 0; i < quarter; i++) {
+			first += cycleCost[i + (cycles > 4 ? 1 : 0)];
+			last += cycleCost[cycles - 1 - i];
+		}
+
+		if (particleCount != particlesWarm || ringPool != ringsWarm) {
+			warnx("soak: pools grew after the first cycle: "
+			    "particles %u -> %u, rings %u -> %u",
+			    particlesWarm, particleCount, ringsWarm, ringPool);
+			status = 1;
+		}
+		if (rss > rssWarm + SOAK_RSS_SLACK) {
+			warnx("soak: rss grew after the first cycle: "
+			    "%lukB -> %lukB", rssWarm, rss);
+			status = 1;
+		}
+		if (last > first * SOAK_COST_GROWTH) {
+			warnx("soak: frame cost grew from %.2fus to %.2fus",
+			    first / quarter, last / quarter);
+			status = 1;
+		}
+	}
+
+	printf("soak %s (%.1fs)\n", status == 0 ? "passed" : "FAILED",
+	    timebaseWallNow() - wallStart);
+
+	free(cycleCost);
+	return status;
+}
+
+/*
+ * Sleep until the next frame is due at the given frame rate.  Deadlines are
+ * absolute so a late wakeup is made up by the next frame instead of adding
+ * up; after falling more than a whole frame behind (or a change of rate) the
+ * schedule restarts from now rather than rushing frames out to catch up.
+ */
+void paceFrame(int frameRate) {
+	static double deadline = 0;
+	double period = 1.0 / frameRate;
+	double now = realtimeNow();
+
+	deadline += period;
+	if (now - deadline > period || deadline - now > period) {
+		deadline = now;
+	}
+
+	if (deadline > now) {
+		TRACE_BEGIN("pace");
+		realtimeSleepUntil(deadline);
+		TRACE_END("pace");
+	}
+}
+
+/*
+ * Save the phase times (in microseconds) of the last complete frame as frame
+ * i of a benchmark result
+ */
+void saveBenchmarkFrame(BenchResult *result, int i) {
+	const ProfilerFrame *frame = profilerLastFrame();
+
+	result->samples[BenchUpdate][i] = frame->phases[PhaseUpdate] * 1000;
+	result->samples[BenchDraw][i] = frame->phases[PhaseDraw] * 1000;
+	result->samples[BenchLines][i] = frame->phases[PhaseLines] * 1000;
+}
+
+/*
+ * Benchmark mode: simulate benchmarkFrames frames headless (no window) with a
+ * fixed timestep and then measure the throughput of every color mode against
+ * the resulting scene.  Every frame does the CPU side of a windowed frame -
+ * updating the scene, filling the colors of every ring and testing every
+ * pair of particles for a line - timed as the update, draw and lines
+ * phases, and with --benchmarkResults the time of each is saved for every
+ * frame (see benchresults.h).
+ */
+#define BENCHMARK_FRAME_TIME 16
+#define BENCHMARK_MINIMUM_TIME 0.5
+void runBenchmark() {
+	double freq = SDL_GetPerformanceFrequency();
+
+	BenchResult result;
+	bool saving = benchmarkResultsFile != NULL;
+
+	if (saving && benchResultInit(&result, benchmarkFrames) != 0) {
+		errx(1, "failed to allocate benchmark results");
+	}
+
+	// fixed seed and virtual time so runs are comparable
+	srand(1);
+	randomizeColors(0);
+	timebaseInit(&timebase, TimebaseVirtual, NULL);
+
+	for (int i = 0; i < benchmarkFrames; i++) {
+		timebaseAdvance(&timebase, BENCHMARK_FRAME_TIME / 1000.0);
+		profilerFrameBegin();
+		if (saving && i > 0) {
+			saveBenchmarkFrame(&result, i - 1);
+		}
+		allocFrameBegin();
+
+		profilerBegin(PhaseUpdate);
+		updateScene(timebaseTick(&timebase));
+		profilerEnd(PhaseUpdate);
+
+		profilerBegin(PhaseDraw);
+		fillFrameColors();
+		profilerEnd(PhaseDraw);
+
+		profilerBegin(PhaseLines);
+		unsigned long pairs = 0;
+		RingNode *ringPtr = rings;
+		for (int j = 0; ringPtr != NULL &&
+		    (particleLineRingDisable == -1 ||
+		    j <= particleLineRingDisable);
+		    ringPtr = ringPtr->next, j++) {
+			countRingLines(ringPtr, &pairs);
+		}
+		profilerEnd(PhaseLines);
+
+		checkAllocationWarmup();
+	}
+	profilerFrameBegin();
+	if (saving && benchmarkFrames > 0) {
+		saveBenchmarkFrame(&result, benchmarkFrames - 1);
+	}
+
+	// the color modes not used above size their scratch buffers below
+	allocSetSteadyState(false);
+
+	unsigned int particles = 0;
+	for (RingNode *ringPtr = rings; ringPtr != NULL;
+	    ringPtr = ringPtr->next) {
+		particles += ringPtr->particleCount;
+	}
+
+	printf("benchmark frames=%d ringCount=%u particles=%u\n",
+	    benchmarkFrames, ringCount, particles);
+
+	colorModeFadeRemaining = 0;
+	for (int m = 0; m < NUM_COLOR_MODES; m++) {
+		unsigned long iterations = 0;
+		double elapsed;
+
+		currentColorMode = m;
+
+		// repeat filling every ring until enough time has passed
+		Uint64 start = SDL_GetPerformanceCounter();
+		do {
+			RingNode *ringPtr = rings;
+			for (int i = 0; ringPtr != NULL;
+			    ringPtr = ringPtr->next, i++) {
+				fillRingColors(ringPtr, i);
+			}
+			iterations++;
+			elapsed = (SDL_GetPerformanceCounter() - start) / freq;
+		} while (elapsed < BENCHMARK_MINIMUM_TIME);
+
+		printf("  %-20s %8.2f Mparticles/s %10.1f ns/frame\n",
+		    colorModes[m].name,
+		    (double)particles * iterations / elapsed / 1e6,
+		    elapsed / iterations * 1e9);
+	}
+
+	// the phases of every simulated frame
+	if (perfCountersEnabled) {
+		profilerPrintSummary(stdout);
+	}
+
+	if (saving) {
+		result.frames = benchmarkFrames;
+		result.ringCount = ringCount;
+		result.particles = particles;
+		if (benchResultAppend(benchmarkResultsFile, &result) != 0) {
+			errx(1, "failed to write %s", benchmarkResultsFile);
+		}
+		printf("appended result to %s\n", benchmarkResultsFile);
+		benchResultFree(&result);
+	}
+}
+
+/*
+ * Scaling sweep: benchmark every combination of sweepRings,
+ * sweepRingTimers, sweepLineFactors and sweepSpawnFactors and print a CSV
+ * line for each of sweepResolutions.  At every point the scene is rebuilt
+ * from the same seed until it holds ringsMaximum rings, then sweepFrames
+ * frames are timed - a frame being what the CPU does each frame with a
+ * window: updating the scene, filling the colors of every ring and testing
+ * every pair of particles for a line.  Frame times are in microseconds.
+ *
+ * The resolution is only used when drawing, so the timed part of a frame is
+ * the same at every resolution and is measured once.  What the resolution
+ * changes is what the GPU is given: after timing each frame the particles
+ * and lines on screen are counted for every resolution, along with an
+ * estimate of the fragments they and the full screen fade cover.
+ *
+ * The simulation runs on the render thread alone, so there is no thread
+ * count to sweep.
+ */
+static const int sweepRings[] = { 5, 10, 20, 35, 50, 70 };
+static const int sweepRingTimers[] = { 250, 500, 1000 };
+static const int sweepLineFactors[] = { 50, 100, 200 };
+static const int sweepSpawnFactors[] = { 50, 100, 200 };
+static const int sweepResolutions[][2] = {
+	{ 1280, 720 },
+	{ 1920, 1080 },
+	{ 3840, 2160 }
+};
+#define NUM_SWEEP(a) (sizeof (a) / sizeof (a[0]))
+#define NUM_SWEEP_RESOLUTIONS NUM_SWEEP(sweepResolutions)
+
+// what one resolution shows over the timed frames of a sweep point
+typedef struct SweepScreen {
+	unsigned long long particles;
+	unsigned long long lines;
+	double fragments;
+} SweepScreen;
+
+static bool sweepOnScreen(const Particle *p, unsigned int res) {
+	return abs(p->x) <= sweepResolutions[res][0] / 2 &&
+	    abs(p->y) <= sweepResolutions[res][1] / 2;
+}
+
+// a line is drawn if either end is on screen, and covers about its length
+static void sweepScreenLine(Particle *p, Particle *p2, int j, int k,
+    void *arg) {
+	SweepScreen *screens = arg;
+	double length = hypot(p2->x - p->x, p2->y - p->y);
+
+	for (unsigned int res = 0; res < NUM_SWEEP_RESOLUTIONS; res++) {
+		if (sweepOnScreen(p, res) || sweepOnScreen(p2, res)) {
+			screens[res].lines++;
+			screens[res].fragments += length;
+		}
+	}
+}
+
+static void sweepScreenFrame(SweepScreen *screens) {
+	RingNode *ringPtr = rings;
+	for (int i = 0; ringPtr != NULL; ringPtr = ringPtr->next, i++) {
+		ParticleNode *a = ringPtr->particleNode;
+		for (; a != NULL; a = a->next) {
+			Particle *p = a->particle;
+			if (p->bornTimer > 0) {
+				continue;
+			}
+			for (unsigned int res = 0;
+			    res < NUM_SWEEP_RESOLUTIONS; res++) {
+				if (sweepOnScreen(p, res)) {
+					screens[res].particles++;
+					screens[res].fragments += M_PI *
+					    p->radius * p->radius;
+				}
+			}
+		}
+		if (particleLineRingDisable == -1 ||
+		    i <= particleLineRingDisable) {
+			ringLines(ringPtr, sweepScreenLine, screens);
+		}
+	}
+
+	for (unsigned int res = 0; res < NUM_SWEEP_RESOLUTIONS; res++) {
+		screens[res].fragments += (double)sweepResolutions[res][0] *
+		    sweepResolutions[res][1];
+	}
+}
+
+static int compareDouble(const void *a, const void *b) {
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+void runSweep() {
+	double freq = SDL_GetPerformanceFrequency();
+	double *times = malloc(sweepFrames * sizeof (double));
+	if (times == NULL) {
+		err(2, "runSweep malloc");
+	}
+
+	printf("ringsMaximum,timerAddNewRing,particleLineDistanceFactor,"
+	    "particleSpawnFactor,windowWidth,windowHeight,particles,"
+	    "pairsTested,linesConnected,particlesOnScreen,linesOnScreen,"
+	    "fragments,framesPerSecond,mparticlesPerSecond,meanUs,p50Us,"
+	    "p90Us,p99Us,maxUs\n");
+
+	for (unsigned int r = 0; r < NUM_SWEEP(sweepRings); r++)
+	for (unsigned int t = 0; t < NUM_SWEEP(sweepRingTimers); t++)
+	for (unsigned int l = 0; l < NUM_SWEEP(sweepLineFactors); l++)
+	for (unsigned int d = 0; d < NUM_SWEEP(sweepSpawnFactors); d++) {
+		ringsMaximum = sweepRings[r];
+		timerAddNewRing = sweepRingTimers[t];
+		particleLineDistanceFactor = sweepLineFactors[l];
+		particleSpawnFactor = sweepSpawnFactors[d];
+
+		// the same scene for every point, grown to ringsMaximum
+		clearRings();
+		srand(1);
+		randomizeColors(0);
+		colorModeFadeRemaining = 0;
+		addNewRingCounter = 0;
+		rainbowIdx = 0;
+		timebaseInit(&timebase, TimebaseVirtual, NULL);
+		while (ringCount < (unsigned int)ringsMaximum) {
+			timebaseAdvance(&timebase, BENCHMARK_FRAME_TIME / 1000.0);
+			updateScene(timebaseTick(&timebase));
+		}
+
+		SweepScreen screens[NUM_SWEEP_RESOLUTIONS];
+		memset(screens, 0, sizeof (screens));
+		unsigned long long particles = 0;
+		unsigned long pairs = 0;
+		unsigned long lines = 0;
+		double total = 0;
+		for (int f = 0; f < sweepFrames; f++) {
+			timebaseAdvance(&timebase, BENCHMARK_FRAME_TIME / 1000.0);
+
+			Uint64 start = SDL_GetPerformanceCounter();
+			updateScene(timebaseTick(&timebase));
+			RingNode *ringPtr = rings;
+			for (int i = 0; ringPtr != NULL;
+			    ringPtr = ringPtr->next, i++) {
+				fillRingColors(ringPtr, i);
+				if (particleLineRingDisable == -1 ||
+				    i <= particleLineRingDisable) {
+					lines += countRingLines(ringPtr,
+					    &pairs);
+				}
+			}
+			times[f] = (SDL_GetPerformanceCounter() - start) /
+			    freq * 1e6;
+			total += times[f];
+
+			particles += particleCount - recycledParticles;
+			sweepScreenFrame(screens);
+		}
+
+		qsort(times, sweepFrames, sizeof (double), compareDouble);
+		for (unsigned int res = 0; res < NUM_SWEEP_RESOLUTIONS;
+		    res++) {
+			printf("%d,%d,%d,%d,%d,%d,%.0f,%.0f,%.0f,%.0f,%.0f,"
+			    "%.0f,%.1f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+			    ringsMaximum, timerAddNewRing,
+			    particleLineDistanceFactor, particleSpawnFactor,
+			    sweepResolutions[res][0],
+			    sweepResolutions[res][1],
+			    (double)particles / sweepFrames,
+			    (double)pairs / sweepFrames,
+			    (double)lines / sweepFrames,
+			    (double)screens[res].particles / sweepFrames,
+			    (double)screens[res].lines / sweepFrames,
+			    screens[res].fragments / sweepFrames,
+			    sweepFrames / total * 1e6,
+			    particles / total,
+			    total / sweepFrames,
+			    times[(int)(sweepFrames * 0.50)],
+			    times[(int)(sweepFrames * 0.90)],
+			    times[(int)(sweepFrames * 0.99)],
+			    times[sweepFrames - 1]);
+		}
+		fflush(stdout);
+	}
+
+	free(times);
+}
+
+/*
+ * Reference implementations for --verify: the straightforward scalar code
+ * the faster paths replaced, kept as it was so they can be checked against
+ * it.  referenceCoordinates() is where a particle is, computed in double
+ * precision (particleCalculateCoordinates() works in float and truncates to
+ * whole pixels), referenceConnected() the original line test of the draw
+ * loop, and referenceColor() the color the original setColor() gave a
+ * particle in a color mode for a magic table.
+ */
+void referenceCoordinates(const Particle *p, double *x, double *y) {
+	double radians = ((double)p->position + 270.0) * M_PI / 180.0;
+
+	*x = (double)p->height * cos(radians);
+	*y = (double)p->height * sin(radians);
+}
+
+bool referenceConnected(const Particle *p, const Particle *p2) {
+	float yd = p2->y -p->y;
+	float xd = p2->x -p->x;
+
+	float d = sqrt((xd * xd) + (yd * yd));
+
+	float maxDistance = (float)p->lineDistance * (particleLineDistanceFactor / 100.0);
+
+	return d < maxDistance;
+}
+
+/*
+ * Connected pairs of particles (by their positions in the ring) of a ring
+ */
+typedef struct VerifyPairs {
+	int (*pairs)[2];
+	unsigned int count;
+	unsigned int size;
+} VerifyPairs;
+
+void recordVerifyPair(Particle *p, Particle *p2, int j, int k, void *arg) {
+	VerifyPairs *v = arg;
+
+	if (v->count == v->size) {
+		v->size = v->size > 0 ? v->size * 2 : 256;
+		v->pairs = realloc(v->pairs, sizeof (v->pairs[0]) * v->size);
+		if (v->pairs == NULL) {
+			err(2, "recordVerifyPair realloc");
+		}
+	}
+
+	v->pairs[v->count][0] = j;
+	v->pairs[v->count][1] = k;
+	v->count++;
+}
+
+int compareVerifyPairs(const void *a, const void *b) {
+	const int *x = a;
+	const int *y = b;
+
+	if (x[0] != y[0]) {
+		return x[0] < y[0] ? -1 : 1;
+	}
+	return (x[1] > y[1]) - (x[1] < y[1]);
+}
+
+/*
+ * The original line loop of a ring, recording every pair it would connect
+ */
+void referenceRingLines(RingNode *ring, VerifyPairs *pairs) {
+	int j = 0;
+	for (ParticleNode *a = ring->particleNode; a != NULL;
+	    a = a->next, j++) {
+		Particle *p = a->particle;
+		if (p->bornTimer > 0) {
+			continue;
+		}
+
+		int k = j + 1;
+		for (ParticleNode *b = a->next; b != NULL; b = b->next, k++) {
+			Particle *p2 = b->particle;
+			if (p2->bornTimer > 0) {
+				continue;
+			}
+			if (referenceConnected(p, p2)) {
+				recordVerifyPair(p, p2, j, k, pairs);
+			}
+		}
+	}
+}
+
+RGB referenceColor(const Particle *p, int i, int mode, float magic[8][3]) {
+	unsigned int idx;
+
+	switch (mode) {
+	case 0: // ColorModeSolid
+		idx = rainbowIdx;
+		break;
+	case 1: // ColorModeRinged
+		idx = rainbowIdx + (i * MAX_COLORS / ringsMaximum);
+		break;
+	case 2: // ColorModeCircular
+		idx = (unsigned int)(p->position / 360.0 * (float)MAX_COLORS);
+		idx = (idx + (int)rainbowIdx) % MAX_COLORS;
+		break;
+	default: // ColorModeIndividual
+		idx = p->color + rainbowIdx;
+		break;
+	}
+
+	idx = idx % MAX_COLORS;
+	RGB rgb = rainbow(idx);
+	return interpolate2rgb(rgb.r, rgb.g, rgb.b, magic);
+}
+
+RGB referenceBlend(RGB from, RGB to, double t) {
+	RGB rgb = {
+		from.r + t * (to.r - from.r),
+		from.g + t * (to.g - from.g),
+		from.b + t * (to.b - from.b)
+	};
+	return rgb;
+}
+
+/*
+ * The reference colors of every particle when a color mode crossfade
+ * started, sorted by node so they can be found with bsearch()
+ */
+typedef struct VerifyFadeFrom {
+	const ParticleNode *node;
+	RGB rgb;
+} VerifyFadeFrom;
+
+typedef struct VerifyFades {
+	VerifyFadeFrom *from;
+	unsigned int count;
+	unsigned int size;
+} VerifyFades;
+
+int compareVerifyFadeFrom(const void *a, const void *b) {
+	const ParticleNode *x = ((const VerifyFadeFrom *)a)->node;
+	const ParticleNode *y = ((const VerifyFadeFrom *)b)->node;
+	return (x > y) - (x < y);
+}
+
+void referenceFadeStart(VerifyFades *fades, float magic[8][3]) {
+	fades->count = 0;
+
+	RingNode *ringPtr = rings;
+	for (int i = 0; ringPtr != NULL; ringPtr = ringPtr->next, i++) {
+		ParticleNode *a = ringPtr->particleNode;
+		for (; a != NULL; a = a->next) {
+			if (fades->count == fades->size) {
+				fades->size = fades->size > 0 ?
+				    fades->size * 2 : 256;
+				fades->from = realloc(fades->from,
+				    sizeof (VerifyFadeFrom) * fades->size);
+				if (fades->from == NULL) {
+					err(2, "referenceFadeStart realloc");
+				}
+			}
+			fades->from[fades->count].node = a;
+			fades->from[fades->count].rgb = referenceColor(
+			    a->particle, i, currentColorMode, magic);
+			fades->count++;
+		}
+	}
+
+	qsort(fades->from, fades->count, sizeof (VerifyFadeFrom),
+	    compareVerifyFadeFrom);
+}
+
+/*
+ * Verify mode: simulate verifyFrames frames headless from a fixed seed in
+ * virtual time, changing the color mode and colors every VERIFY_STEP frames
+ * (crossfading both over VERIFY_FADE milliseconds) and clearing the rings
+ * every VERIFY_CLEAR frames, and check every frame against the reference
+ * implementations above:
+ *
+ * - the x and y of every particle must be within VERIFY_POSITION_TOLERANCE
+ *   of the double precision position (truncating to whole pixels loses up
+ *   to one, float rounding a little more)
+ * - the set of connected pairs of every ring must match exactly
+ * - the color of every born particle (what the rasterizer is given, the
+ *   frame itself can't be read back without a window) may differ from the
+ *   reference by at most VERIFY_COLOR_TOLERANCE per channel.  While a fade
+ *   is in progress the reference is the old and new magic table's colors
+ *   blended, blended again from each particle's reference color in the old
+ *   mode when the fade started.
+ *
+ * The first divergence is reported and the run stops there.  Fades never
+ * overlap, so the reference only has to know about one at a time.  Returns
+ * the exit status.
+ */
+#define VERIFY_STEP 125
+#define VERIFY_CLEAR 1999
+#define VERIFY_FADE 1000
+#define VERIFY_POSITION_TOLERANCE 1.01
+#define VERIFY_COLOR_TOLERANCE (1.0 / 255.0)
+#if VERIFY_FADE >= VERIFY_STEP * BENCHMARK_FRAME_TIME
+#error "verify fades must end before the next one starts"
+#endif
+int runVerify() {
+	unsigned long particlesChecked = 0;
+	unsigned long pairsChecked = 0;
+	unsigned long colorsChecked = 0;
+	VerifyPairs gotPairs = { NULL, 0, 0 };
+	VerifyPairs wantPairs = { NULL, 0, 0 };
+	VerifyFades fades = { NULL, 0, 0 };
+	float fromMagic[8][3];
+	unsigned int fadeElapsed = VERIFY_FADE;
+	unsigned long colorsFading = 0;
+	double positionMaxError = 0;
+	double colorMaxError = 0;
+	double colorSquaredError = 0;
+
+	srand(1);
+	timerColorFade = 0;
+	randomizeColors(0);
+	colorModeFadeRemaining = 0;
+	timerColorFade = VERIFY_FADE;
+	timebaseInit(&timebase, TimebaseVirtual, NULL);
+
+	printf("verify frames=%d\n", verifyFrames);
+	printColorCube();
+
+	for (int frame = 0; frame < verifyFrames; frame++) {
+		if (frame % VERIFY_STEP == VERIFY_STEP - 1) {
+			referenceFadeStart(&fades, randomMagic);
+			memcpy(fromMagic, randomMagic, sizeof (fromMagic));
+			fadeElapsed = 0;
+
+			startColorModeFade((currentColorMode + 1) %
+			    NUM_COLOR_MODES);
+			randomizeColors(timerColorFade);
+		}
+		if (frame % VERIFY_CLEAR == VERIFY_CLEAR - 1) {
+			clearRings();
+		}
+
+		timebaseAdvance(&timebase, BENCHMARK_FRAME_TIME / 1000.0);
+		updateScene(timebaseTick(&timebase));
+		if (fadeElapsed < VERIFY_FADE) {
+			fadeElapsed += BENCHMARK_FRAME_TIME;
+		}
+		bool fading = fadeElapsed < VERIFY_FADE;
+		double t = (double)fadeElapsed / VERIFY_FADE;
+
+		RingNode *ringPtr = rings;
+		for (int i = 0; ringPtr != NULL; ringPtr = ringPtr->next, i++) {
+			RGB *colors = fillRingColors(ringPtr, i);
+			bool lines = particleLineRingDisable == -1 ||
+			    i <= particleLineRingDisable;
+			int j = 0;
+
+			for (ParticleNode *a = ringPtr->particleNode; a != NULL;
+			    a = a->next, j++) {
+				Particle *p = a->particle;
+				double x, y;
+
+				referenceCoordinates(p, &x, &y);
+				double off = fmax(fabs(p->x - x), fabs(p->y - y));
+				if (off > positionMaxError) {
+					positionMaxError = off;
+				}
+				if (off > VERIFY_POSITION_TOLERANCE) {
+					printf("frame %d ring %d particle %d: "
+					    "position %d,%d reference %.3f,%.3f"
+					    "\n", frame, i, j, p->x, p->y, x, y);
+					return 1;
+				}
+				particlesChecked++;
+
+				if (p->bornTimer > 0) {
+					continue;
+				}
+
+				RGB want = referenceColor(p, i,
+				    currentColorMode, randomMagic);
+				if (fading) {
+					want = referenceBlend(referenceColor(p,
+					    i, currentColorMode, fromMagic),
+					    want, t);
+				}
+				if (fading && a->fading) {
+					VerifyFadeFrom key = { a };
+					VerifyFadeFrom *from = bsearch(&key,
+					    fades.from, fades.count,
+					    sizeof (VerifyFadeFrom),
+					    compareVerifyFadeFrom);
+					if (from == NULL) {
+						printf("frame %d ring %d "
+						    "particle %d: fading but "
+						    "wasn't there when the "
+						    "fade started\n", frame, i,
+						    j);
+						return 1;
+					}
+					want = referenceBlend(from->rgb, want,
+					    t);
+				}
+				if (fading) {
+					colorsFading++;
+				}
+				double error = fmax(fabs(colors[j].r - want.r),
+				    fmax(fabs(colors[j].g - want.g),
+				    fabs(colors[j].b - want.b)));
+				colorSquaredError += error * error;
+				colorsChecked++;
+				if (error > colorMaxError) {
+					colorMaxError = error;
+				}
+				if (error > VERIFY_COLOR_TOLERANCE) {
+					printf("frame %d ring %d particle %d: "
+					    "color %.4f,%.4f,%.4f reference "
+					    "%.4f,%.4f,%.4f (%s%s)\n", frame, i,
+					    j, colors[j].r, colors[j].g,
+					    colors[j].b, want.r, want.g, want.b,
+					    colorModes[currentColorMode].name,
+					    fading ? ", fading" : "");
+					return 1;
+				}
+
+			}
+
+			if (!lines) {
+				continue;
+			}
+
+			// the pairs the line pass connects against the ones the
+			// original loop does
+			gotPairs.count = 0;
+			wantPairs.count = 0;
+			ringLines(ringPtr, recordVerifyPair, &gotPairs);
+			referenceRingLines(ringPtr, &wantPairs);
+			qsort(gotPairs.pairs, gotPairs.count,
+			    sizeof (gotPairs.pairs[0]), compareVerifyPairs);
+			qsort(wantPairs.pairs, wantPairs.count,
+			    sizeof (wantPairs.pairs[0]), compareVerifyPairs);
+
+			unsigned int g = 0;
+			unsigned int w = 0;
+			while (g < gotPairs.count || w < wantPairs.count) {
+				int c = g == gotPairs.count ? 1 :
+				    w == wantPairs.count ? -1 :
+				    compareVerifyPairs(gotPairs.pairs[g],
+				    wantPairs.pairs[w]);
+				if (c != 0) {
+					int *pair = c < 0 ? gotPairs.pairs[g] :
+					    wantPairs.pairs[w];
+					printf("frame %d ring %d pair %d,%d: "
+					    "%s, reference %s\n", frame, i,
+					    pair[0], pair[1], c < 0 ?
+					    "connected" : "not connected",
+					    c < 0 ? "not connected" :
+					    "connected");
+					return 1;
+				}
+				g++;
+				w++;
+			}
+			pairsChecked += gotPairs.count;
+		}
+	}
+
+	free(gotPairs.pairs);
+	free(wantPairs.pairs);
+	free(fades.from);
+
+	printf("  positions %lu within %.2f (max %.6f)\n", particlesChecked,
+	    VERIFY_POSITION_TOLERANCE, positionMaxError);
+	printf("  lines     %lu identical\n", pairsChecked);
+	printf("  colors    %lu within %.4f (max %.6f, rms %.6f), %lu of "
+	    "them fading\n", colorsChecked, VERIFY_COLOR_TOLERANCE,
+	    colorMaxError, colorsChecked > 0 ?
+	    sqrt(colorSquaredError / colorsChecked) : 0, colorsFading);
+	printf("verify passed\n");
+
+	return 0;
+}
+
+/*
+ * Main method!
+ */
+int main(int argc, char **argv) {
+	int printStatusLineCounter = 0;
+
+	// parse CLI options
+	parseArguments(argv);
+
+	// start tracing (flushed on exit, including errx())
+	if (traceFile != NULL) {
+		if (traceStart(traceFile) != 0) {
+			errx(1, "failed to start trace");
+		}
+		atexit(traceStop);
+		traceThreadName("render");
+	}
+
+	// hardware counters are optional, the rest works without them
+	if (perfCountersEnabled) {
+		perfCountersEnabled = profilerEnablePerfCounters();
+	}
+
+	// let other processes watch and control us (soak mode included)
+	if (telemetryName != NULL) {
+		telemetry = telemetryCreate(telemetryName, profilerPhaseNames,
+		    PHASE_COUNT);
+		if (telemetry == NULL) {
+			errx(1, "failed to create telemetry block %s",
+			    telemetryName);
+		}
+		atexit(stopTelemetry);
+	}
+
+	// benchmark mode runs without a window
+	if (benchmarkFrames > 0) {
+		runBenchmark();
+		return 0;
+	}
+
+	// as does soak mode
+	if (soakSeconds > 0) {
+		return runSoak();
+	}
+
+	// and the scaling sweep
+	if (sweepFrames > 0) {
+		runSweep();
+		return 0;
+	}
+
+	// and checking against the reference implementation
+	if (verifyFrames > 0) {
+		return runVerify();
+	}
+
+	// so does writing a feature track
+	if (analyzeFile != NULL) {
+		if (audioFile == NULL) {
+			errx(1, "--analyze requires --audio");
+		}
+		audio = audioOpen(audioFile);
+		if (audio == NULL) {
+			errx(1, "failed to open %s", audioFile);
+		}
+
+		long threads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (threads < 1) {
+			threads = 1;
+		}
+
+		double start = timebaseWallNow();
+		if (featureTrackAnalyze(audio, analyzeFile, featureTrackFps,
+		    AUDIO_FFT_SIZE, threads) != 0) {
+			errx(1, "failed to analyze %s", audioFile);
+		}
+		printf("wrote %s (%.1fs of audio in %.2fs with %ld threads)\n",
+		    analyzeFile, (double)audio->frames / audio->rate,
+		    timebaseWallNow() - start, threads);
+
+		audioClose(audio);
+		return 0;
+	}
+
+	// lock memory before any worker thread starts, the workers then move
+	// themselves off of the render CPU
+	if (realtimeMode) {
+		if (realtimeStart(realtimeRenderCpu, realtimeWorkerCpu) != 0) {
+			warnx("realtime mode is only partially enabled");
+		}
+		prefaultScene();
+		realtimePrefaultStack(512 * 1024);
+		printf("realtime: prefaulted %u rings and %u particles\n",
+		    recycledRings, recycledParticles);
+	}
+
+	if (metricsFile != NULL) {
+		metrics = metricsOpen(metricsFile);
+		if (metrics == NULL) {
+			errx(1, "failed to open %s", metricsFile);
+		}
+	}
+
+	if (featureTrackFile != NULL) {
+		featureTrack = featureTrackOpen(featureTrackFile);
+		if (featureTrack == NULL) {
+			errx(1, "failed to open %s", featureTrackFile);
+		}
+	}
+
+	// initalize SDL and OpenGL window
+	SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
+	window = SDL_CreateWindow("Undercurrents", 0, 0,
 	    windowWidth, windowHeight, SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE);
 	assert(window != NULL);
 	SDL_GLContext context = SDL_GL_CreateContext(window);
@@ -851,8 +3231,51 @@ int main(int argc, char **argv) {
 	// initialize random
 	srand(time(NULL));
 
+	hud = hudCreate();
+	if (hud == NULL) {
+		errx(1, "failed to create HUD");
+	}
+
+	// GPU timing is optional
+	gpuTimer = gpuTimerCreate();
+
+	overdraw = overdrawCreate();
+	if (overdraw == NULL) {
+		errx(1, "failed to create overdraw buffers");
+	}
+
 	// initialize random colors
-	randomizeMagic(randomMagic);
+	randomizeColors(0);
+	printColorCube();
+
+	// start the music
+	if (audioFile != NULL) {
+		audio = audioOpen(audioFile);
+		if (audio == NULL || !audioStart(audio)) {
+			errx(1, "failed to play %s", audioFile);
+		}
+	}
+
+	// pin the render thread and raise its priority now that SDL's and the
+	// GL driver's threads exist, so they don't inherit either
+	if (realtimeMode && realtimeRenderThread(realtimePriority) != 0) {
+		warnx("realtime mode is only partially enabled");
+	}
+
+	// follow the music if there is any.  a feature track without music is
+	// stepped one track frame per rendered frame instead, so it lines up
+	// however fast frames are drawn, starting featureTrackStart in
+	if (audio != NULL) {
+		if (featureTrackStart > 0) {
+			errx(1, "featureTrackStart can't be used with --audio");
+		}
+		timebaseInit(&timebase, TimebaseAudio, audio);
+	} else if (featureTrack != NULL) {
+		timebaseInit(&timebase, TimebaseVirtual, NULL);
+		timebaseStartAt(&timebase, featureTrackStart / 1000.0);
+	} else {
+		timebaseInit(&timebase, TimebaseWall, NULL);
+	}
 
 	// print config and controls
 	printConfiguration(stdout);
@@ -860,30 +3283,69 @@ int main(int argc, char **argv) {
 	printControls(stdout);
 	printf("\n");
 
+	// route runtime output through the logger so a slow stdout/stderr
+	// can't stall a frame (drained on exit, including errx())
+	if (logStart() == 0) {
+		atexit(logStop);
+	}
+
 	// main loop
 	running = true;
 	while (running) {
-		RingNode *ringPtr;
-		unsigned int currentTime;
 		unsigned int delta;
+		bool countingOverdraw = false;
+
+		// finish timing the last frame
+		profilerFrameBegin();
+		if (telemetry != NULL) {
+			publishTelemetry();
+			applyTelemetryCommands();
+		}
+		recordMetrics();
+		hudRecordFrame(hud, profilerLastFrame());
+
+		// GPU times from a few frames ago, if they are ready
+		double gpuTimes[GPU_PASS_COUNT];
+		if (gpuTimerFrameBegin(gpuTimer, gpuTimes)) {
+			profilerGpuTimes(gpuTimes);
+		}
+
+		// calculate time since last iteration (and step virtual time to
+		// the next feature track frame)
+		delta = timebaseTick(&timebase);
+		if (featureTrack != NULL && !paused) {
+			timebaseAdvance(&timebase,
+			    1.0 / featureTrack->header->fps);
+		}
+		checkAllocationWarmup();
+
+		// write out the trace if asked to (SIGUSR1)
+		if (traceFlushRequested) {
+			traceFlush();
+		}
 
-		// calculate time since last iteration
-		currentTime = SDL_GetTicks();
-		delta = currentTime - lastTime;
-		lastTime = currentTime;
+		// nothing on screen changes while paused, blank or hidden so
+		// block until there is input (or idleTimeout passes) instead of
+		// spinning
+		if ((paused || blankMode || windowHidden) && idleTimeout > 0) {
+			TRACE_BEGIN("idle");
+			SDL_WaitEventTimeout(NULL, idleTimeout);
+			TRACE_END("idle");
+		}
 
 		// process events
+		profilerBegin(PhaseEvents);
 		processEvents();
+		profilerEnd(PhaseEvents);
 
-		// check if status line should be printed
+		// check if status line should be printed (0 disables it)
 		printStatusLineCounter -= delta;
-		if (printStatusLineCounter <= 0) {
+		if (timerPrintStatusLine == 0) {
+			printStatusLineCounter = 0;
+		} else if (printStatusLineCounter <= 0) {
 			printStatusLineCounter += timerPrintStatusLine;
 
-			printf("fps=%f ringCount=%u particleCount=%u "
-			    "recycledParticles=%u\n",
-			    1000.0 / delta, ringCount, particleCount,
-			    recycledParticles);
+			printStatusLine();
 
 			int i = 0;
 			while (printStatusLineCounter <= 0) {
@@ -891,7 +3353,7 @@ int main(int argc, char **argv) {
 				printStatusLineCounter += timerPrintStatusLine;
 			}
 			if (i > 0) {
-				fprintf(stderr,
+				logPrintf(stderr,
 				    "[warn] missed %d status line calls\n", i);
 			}
 		}
@@ -901,185 +3363,75 @@ int main(int argc, char **argv) {
 			goto swap;
 		}
 
-		// clear screen
-		float alpha = fadingMode ? ((float)alphaBackground / 100.0) : 1.0;
-		glColor4f(0.0f, 0.0f, 0.0f, alpha);
-		glRecti(0, 0, windowWidth, windowHeight);
-
-		// check if new ring (and particles) should be created
-		addNewRingCounter -= delta;
-		if (addNewRingCounter <= 0) {
-			addNewRingCounter += timerAddNewRing;
-
-			// add a new ring
-			addRing();
-
-			// recycle out-of-view rings
-			while (ringCount > ringsMaximum) {
-				recycleLastRing();
-				ringCount--;
-			}
-
-			// add particle(s) to each existing ring
-			ringPtr = rings;
-			for (int i = 0; ringPtr != NULL; ringPtr = ringPtr->next, i++) {
-				/*
-				 * Calculate how many particles to add
-				 *
-				 * I'd like to make this function somehow more
-				 * configurable.  The basic idea is that 'i' is
-				 * the number of the current ring being
-				 * processed, where 0 is always the innermost
-				 * ring and the number increments as we loop
-				 * towards the more outside rings.
-				 */
-				int num = (i / 4) + 4;
-
-				for (int j = 0; j < num; j++) {
-					ParticleNode *head = ringPtr->particleNode;
-					ParticleNode *new = makeOrReclaimRandomizedParticleNode();
-
-					if (head != NULL) {
-						assert(head->particle);
-						/*
-						 * We use one of the particles
-						 * existing height as an offset
-						 * for the newly calculated
-						 * particle.  This is a little
-						 * sus but it works.
-						 */
-						new->particle->height += head->particle->height;
-					}
-
-					new->next = head;
-					ringPtr->particleNode = new;
-				}
-			}
-
-			int i = 0;
-			while (addNewRingCounter <= 0) {
-				i++;
-				addNewRingCounter += timerAddNewRing;
-			}
-			if (i > 0) {
-				fprintf(stderr, "[warn] missed %d add ring calls\n", i);
+		// clear screen and advance the simulation
+		profilerBegin(PhaseClear);
+		if (overdrawMode) {
+			if (overdrawBegin(overdraw, windowWidth,
+			    windowHeight) == 0) {
+				countingOverdraw = true;
+			} else {
+				overdrawMode = false;
+				logPrintf(stdout, "overdraw unavailable\n");
 			}
 		}
+		clearScreen();
+		profilerEnd(PhaseClear);
 
-		// Update rainbow index
-		rainbowIdx += (float)delta / 1000.0 * particleColorSpeed;
-		while (rainbowIdx > MAX_COLORS) { rainbowIdx -= MAX_COLORS; }
-		while (rainbowIdx <= 0) { rainbowIdx += MAX_COLORS; }
-
-		// calculate new particle locations
-		ringPtr = rings;
-		for (; ringPtr != NULL; ringPtr = ringPtr->next) {
-			ParticleNode *particlePtr = ringPtr->particleNode;
-
-			// loop particles in ring
-			for (; particlePtr != NULL; particlePtr = particlePtr->next) {
-				Particle *p = particlePtr->particle;
-
-				float speedRate = particleSpeedFactor / 100.0;
-
-				// update particle location
-				p->height += (float)delta * (float)particleExpandRate / 1000.0;
-				p->position += (float)delta * ((float)p->speed / p->height / 5.0 * speedRate);
-				particleCalculateCoordinates(p);
-
-				// reduce bornTimer by delta
-				if (p->bornTimer != 0) {
-					p->bornTimer -= delta;
-					if (p->bornTimer < 0) {
-						p->bornTimer = 0;
-					}
-				}
-			}
-		}
+		profilerBegin(PhaseUpdate);
+		applyAudioFeatures();
+		updateScene(delta);
+		profilerEnd(PhaseUpdate);
 
-		// just finish if blank mode is set
-		if (blankMode) {
+		// just finish if blank mode is set or nothing can be seen
+		if (blankMode || windowHidden) {
 			goto swap;
 		}
 
-		// set the color here just once if in solid mode
-		if (currentColorMode == ColorModeSolid) {
-			setColor(rainbowIdx, randomMagic, alphaElements);
-		}
-
-		// draw the particles and lines, start by looping rings
-		ringPtr = rings;
-		for (int i = 0; ringPtr != NULL; ringPtr = ringPtr->next, i++) {
-			ParticleNode *particlePtr = ringPtr->particleNode;
-
-			// set color here if ringed mode
-			if (currentColorMode == ColorModeRinged) {
-				unsigned int idx = rainbowIdx + (i * MAX_COLORS / ringsMaximum);
-				setColor(idx, randomMagic, alphaElements);
-			}
-
-			// loop particles in ring
-			for (; particlePtr != NULL; particlePtr = particlePtr->next) {
-				Particle *p = particlePtr->particle;
-
-				// check if particle is born
-				if (p->bornTimer > 0) {
-					continue;
-				}
-
-				// set color here if circular mode or random mode
-				if (currentColorMode == ColorModeCircular) {
-					unsigned int idx = (unsigned int)(p->position / 360.0 * (float)MAX_COLORS);
-					idx = (idx + (int)rainbowIdx) % MAX_COLORS;
-					setColor(idx, randomMagic, alphaElements);
-				} else if (currentColorMode == ColorModeIndividual) {
-					setColor(p->color + rainbowIdx, randomMagic, alphaElements);
-				}
-
-				// draw the particle
-				DrawParticle(p);
-
-				// stop here if lines aren't enabled
-				if (!linesEnabled) {
-					continue;
-				}
-
-				// check if this ring has lines disabled
-				if (particleLineRingDisable != -1 && i > particleLineRingDisable) {
-					continue;
-				}
-
-				// draw connected lines to any particles NEXT
-				// in the ring/orbit
-				ParticleNode *particlePtr2 = particlePtr->next;
-				for (; particlePtr2 != NULL; particlePtr2 = particlePtr2->next) {
-					Particle *p2 = particlePtr2->particle;
-
-					if (p2->bornTimer > 0) {
-						continue;
-					}
-
-					float yd = p2->y -p->y;
-					float xd = p2->x -p->x;
+		drawScene();
 
-					// distance between 2 particles
-					float d = sqrt((xd * xd) + (yd * yd));
+swap:
+		// replace the frame with its overdraw heatmap
+		if (countingOverdraw) {
+			profilerBegin(PhaseDraw);
+			overdrawEnd(overdraw);
+			profilerEnd(PhaseDraw);
+		}
 
-					float maxDistance = (float)p->lineDistance * (particleLineDistanceFactor / 100.0);
+		// a hidden window has nothing to show
+		if (windowHidden) {
+			SDL_Delay(1);
+			continue;
+		}
 
-					// draw a line between the particles
-					if (d < maxDistance) {
-						DrawLinesConnectingParticles(p, p2);
-					}
-				}
-			}
+		// draw the HUD over everything
+		if (hudEnabled) {
+			profilerBegin(PhaseHud);
+			drawHud();
+			profilerEnd(PhaseHud);
 		}
 
-swap:
 		// swap windows
+		profilerBegin(PhaseSwap);
 		SDL_GL_SwapWindow(window);
-		SDL_Delay(1);
+		profilerEnd(PhaseSwap);
+
+		if (!windowFocused && unfocusedFrameRate > 0) {
+			paceFrame(unfocusedFrameRate);
+		} else if (realtimeMode && realtimeFrameRate > 0) {
+			paceFrame(realtimeFrameRate);
+		} else {
+			SDL_Delay(1);
+		}
 	}
 
+	audioClose(audio);
+	featureTrackClose(featureTrack);
+	metricsClose(metrics);
+	hudDestroy(hud);
+	gpuTimerDestroy(gpuTimer);
+	overdrawDestroy(overdraw);
+	logStop();
+	profilerPrintSummary(stdout);
+
 	return 0;
 }
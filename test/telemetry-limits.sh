@@ -0,0 +1,85 @@
+#!/usr/bin/env bash
+#
+# Send out of range configuration values to a running undercurrents through
+# ucctl and check that they are all rejected, that a valid one still gets
+# through and that the simulation keeps running afterwards.  The simulation
+# runs headless in soak mode, which applies commands between frames the same
+# way the windowed loop does.
+#
+# Author: Dave Eddy <dave@daveeddy.com>
+# Date: December 12, 2020
+# License: MIT
+
+cd "$(dirname "$0")/.." || exit
+
+name=/undercurrents-test-$$
+log=$(mktemp)
+
+# name value pairs that must be rejected
+bad=(
+	timerAddNewRing 0
+	ringsMaximum 0
+	particleSpeedMaximum 0
+	particleBornTimerMaximum 0
+	windowWidth 0
+	featureTrackFps 0
+	realtimeFrameRate 0
+	particleLineRingDisable -2
+	timerColorFade -1
+	currentColorMode 99
+)
+good=(particleColorSpeed 75)
+
+fail() {
+	echo "FAIL: $*" >&2
+	cat "$log" >&2
+	exit 1
+}
+
+# read a single field from `ucctl stats`
+stat() {
+	./ucctl -n "$name" stats | tr ' ' '\n' | sed -n "s/^$1=//p"
+}
+
+./undercurrents --soak 720 --telemetry "$name" > "$log" 2>&1 &
+pid=$!
+# killing undercurrents (or a crash) leaves its shared memory object behind
+cleanup() {
+	kill "$pid" 2> /dev/null
+	wait "$pid" 2> /dev/null
+	rm -f "$log" "/dev/shm$name"
+}
+trap cleanup EXIT
+
+# wait for the telemetry block
+for ((i = 0; i < 50; i++)); do
+	./ucctl -n "$name" stats > /dev/null 2>&1 && break
+	sleep 0.1
+done
+./ucctl -n "$name" stats > /dev/null || fail 'telemetry block never appeared'
+
+./ucctl -n "$name" set "${bad[@]}" "${good[@]}" || fail 'ucctl set failed'
+
+# wait for every command to be handled
+want=$(( (${#bad[@]} + ${#good[@]}) / 2 ))
+for ((i = 0; i < 50; i++)); do
+	applied=$(stat commandsApplied)
+	rejected=$(stat commandsRejected)
+	(( applied + rejected >= want )) && break
+	sleep 0.1
+done
+
+(( rejected == ${#bad[@]} / 2 )) ||
+    fail "expected $(( ${#bad[@]} / 2 )) rejected commands, got $rejected"
+(( applied == ${#good[@]} / 2 )) ||
+    fail "expected $(( ${#good[@]} / 2 )) applied commands, got $applied"
+
+# and nothing hung or crashed
+before=$(stat frame)
+sleep 0.5
+after=$(stat frame)
+(( after > before )) || fail "simulation stopped at frame $before"
+kill -0 "$pid" 2> /dev/null || fail 'undercurrents exited'
+
+echo "ok: $rejected out of range values rejected, $applied applied," \
+    "still running (frame $after)"